@@ -0,0 +1,104 @@
+/*
+ * bench_size_class.c
+ * Microbenchmark of calc_size_class() in mm.c against the shift loop
+ * it replaced. Sizes are drawn from a mix that is mostly small blocks
+ * with a tail of large ones, like the traces.
+ *
+ * With the default class layout (one class per power of two) the two
+ * versions are also checked to agree on every block size up to 1MB.
+ * make bench_size_class-41 builds this file and mm.c with 4 classes
+ * per power of two instead.
+ *
+ * usage: bench_size_class [-n lookups]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+
+#define WSIZE           sizeof(void *)
+#define DSIZE           (2 * WSIZE)
+#define MIN_BLOCK_SIZE  (2 * DSIZE)
+#define MIN(x,y) ((x) < (y)?(x): (y))
+
+#ifndef NUM_LISTS
+#define NUM_LISTS 11
+#endif
+
+#define NUM_SIZES 4096
+
+/* keeps the lookups from being optimized away */
+volatile long sink;
+
+int calc_size_class(size_t sz);
+
+/* the original loop from mm.c */
+__attribute__((noinline))
+int calc_size_class_loop(size_t sz) {
+    int i = 0, bucket_sz = MIN_BLOCK_SIZE;
+    while(sz > bucket_sz && i < NUM_LISTS) {
+        bucket_sz = bucket_sz << 1;
+        i++;
+    }
+
+    return MIN(i, NUM_LISTS - 1);
+}
+
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double time_lookups(int (*f)(size_t), size_t *sizes, long n)
+{
+    double start = now();
+    long i, sum = 0;
+    for (i = 0; i < n; i++) {
+        sum += f(sizes[i & (NUM_SIZES - 1)]);
+    }
+    sink += sum;
+    return (now() - start) * 1e9 / n;
+}
+
+int main(int argc, char *argv[])
+{
+    long n = 100000000;
+    size_t sizes[NUM_SIZES];
+    unsigned seed = 1;
+#if NUM_LISTS == 11
+    size_t sz;
+#endif
+    int c, i;
+
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+        case 'n': n = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n lookups]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < NUM_SIZES; i++) {
+        // 3/4 small blocks, the rest spread up to 64KB
+        size_t max = (i % 4) ? 512 : 65536;
+        sizes[i] = MIN_BLOCK_SIZE + DSIZE * (rand_r(&seed) % (max / DSIZE));
+    }
+
+#if NUM_LISTS == 11
+    for (sz = MIN_BLOCK_SIZE; sz <= (1 << 20); sz += DSIZE) {
+        if (calc_size_class(sz) != calc_size_class_loop(sz)) {
+            printf("mismatch for size %zu: %d vs %d\n", sz,
+                   calc_size_class(sz), calc_size_class_loop(sz));
+            return 1;
+        }
+    }
+#endif
+
+    printf("shift loop:      %6.2f ns/lookup\n", time_lookups(calc_size_class_loop, sizes, n));
+    printf("calc_size_class: %6.2f ns/lookup\n", time_lookups(calc_size_class, sizes, n));
+    return 0;
+}
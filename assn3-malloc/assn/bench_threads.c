@@ -0,0 +1,141 @@
+/*
+ * bench_threads.c
+ * Measures allocation throughput of the thread-safe build of mm.c
+ * (-DTHREAD_SAFE) as the number of threads goes from 1 to N.
+ *
+ * Every thread keeps a window of live blocks and repeatedly frees a
+ * random one and allocates a block of random size in its place. The
+ * heap is re-initialized between runs, so every thread count starts
+ * from the same empty heap.
+ *
+ * usage: bench_threads [-t max_threads] [-n ops_per_thread]
+ *                      [-s max_size] [-w window]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+int num_ops = 1000000;
+int max_size = 256;
+int window = 64;
+
+pthread_barrier_t start_barrier;
+
+typedef struct thread_arg {
+    unsigned seed;
+    int failed;
+} thread_arg;
+
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void *worker(void *p)
+{
+    thread_arg *arg = (thread_arg*)p;
+    void **live = calloc(window, sizeof(void*));
+    int i;
+
+    pthread_barrier_wait(&start_barrier);
+    for (i = 0; i < num_ops; i++) {
+        int slot = rand_r(&arg->seed) % window;
+        size_t size = 1 + rand_r(&arg->seed) % max_size;
+        mm_free(live[slot]);
+        if ((live[slot] = mm_malloc(size)) == NULL) {
+            arg->failed = 1;
+            break;
+        }
+        // touch the payload so the block is really used
+        *(char*)live[slot] = (char)i;
+    }
+    for (i = 0; i < window; i++) {
+        mm_free(live[i]);
+    }
+    free(live);
+    return NULL;
+}
+
+/* run the workload on n threads, return elapsed seconds */
+double run(int n)
+{
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    thread_arg *args = calloc(n, sizeof(thread_arg));
+    double start, end;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, n + 1);
+    for (i = 0; i < n; i++) {
+        args[i].seed = i + 1;
+        pthread_create(&threads[i], NULL, worker, &args[i]);
+    }
+    pthread_barrier_wait(&start_barrier);
+    start = now();
+    for (i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    end = now();
+    pthread_barrier_destroy(&start_barrier);
+
+    for (i = 0; i < n; i++) {
+        if (args[i].failed) {
+            fprintf(stderr, "mm_malloc returned NULL with %d threads\n", n);
+            exit(1);
+        }
+    }
+    free(threads);
+    free(args);
+    return end - start;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+    int c, n;
+
+    while ((c = getopt(argc, argv, "t:n:s:w:")) != -1) {
+        switch (c) {
+        case 't': max_threads = atoi(optarg); break;
+        case 'n': num_ops = atoi(optarg); break;
+        case 's': max_size = atoi(optarg); break;
+        case 'w': window = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-t max_threads] [-n ops_per_thread] "
+                    "[-s max_size] [-w window]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (max_threads < 1 || num_ops < 1 || max_size < 1 || window < 1) {
+        fprintf(stderr, "all options must be positive\n");
+        exit(1);
+    }
+
+    mem_init();
+    printf("%8s %14s %10s\n", "threads", "allocs/sec", "speedup");
+    // 1, 2, 4, ... and finally max_threads itself
+    for (n = 1; ; n = (n * 2 < max_threads) ? n * 2 : max_threads) {
+        double secs = run(n);
+        double rate = (double)n * num_ops / secs;
+        if (n == 1) base = rate;
+        printf("%8d %14.0f %9.2fx\n", n, rate, rate / base);
+        if (n == max_threads) break;
+    }
+    mem_deinit();
+    return 0;
+}
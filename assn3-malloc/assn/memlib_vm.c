@@ -0,0 +1,105 @@
+/*
+ * memlib_vm.c
+ * A stand-in for memlib.o that backs mem_sbrk with real virtual memory
+ * instead of a 20MB array taken from malloc, for running mm.c under
+ * real programs (see mm_preload.c). mem_init reserves HEAP_RESERVE
+ * bytes of address space without committing any of it, the kernel
+ * only backs a page once the heap has grown over it and it is touched.
+ * A reservation the kernel refuses is retried at half the size.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "memlib.h"
+
+#ifndef HEAP_RESERVE
+#define HEAP_RESERVE (1UL << 36)    /* address space reserved for the heap */
+#endif
+
+#define MIN_RESERVE (1UL << 24)
+
+static char *mem_start_brk;  /* first byte of the heap */
+static char *mem_brk;        /* last byte of the heap plus 1 */
+static char *mem_max_addr;   /* end of the reservation plus 1 */
+
+/*
+ * mem_init - reserve the address space of the heap
+ */
+void mem_init(void)
+{
+    size_t len = HEAP_RESERVE;
+    void *base = MAP_FAILED;
+
+    while (len >= MIN_RESERVE) {
+        base = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base != MAP_FAILED)
+            break;
+        len /= 2;
+    }
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "mem_init: cannot reserve the heap\n");
+        exit(1);
+    }
+    mem_start_brk = base;
+    mem_brk = mem_start_brk;
+    mem_max_addr = mem_start_brk + len;
+}
+
+/*
+ * mem_deinit - give the reservation back
+ */
+void mem_deinit(void)
+{
+    munmap(mem_start_brk, mem_max_addr - mem_start_brk);
+}
+
+/*
+ * mem_sbrk - grow the heap by incr bytes and return the old break,
+ *    or (void *)-1 with errno set to ENOMEM when it is out of room.
+ *    Like memlib, the heap never shrinks
+ */
+void *mem_sbrk(intptr_t incr)
+{
+    char *old_brk = mem_brk;
+
+    if (incr < 0 || incr > mem_max_addr - mem_brk) {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    mem_brk += incr;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_reset_brk - empty the heap and release its pages
+ */
+void mem_reset_brk(void)
+{
+    madvise(mem_start_brk, mem_brk - mem_start_brk, MADV_DONTNEED);
+    mem_brk = mem_start_brk;
+}
+
+void *mem_heap_lo(void)
+{
+    return (void *)mem_start_brk;
+}
+
+void *mem_heap_hi(void)
+{
+    return (void *)(mem_brk - 1);
+}
+
+size_t mem_heapsize(void)
+{
+    return (size_t)(mem_brk - mem_start_brk);
+}
+
+size_t mem_pagesize(void)
+{
+    return (size_t)getpagesize();
+}
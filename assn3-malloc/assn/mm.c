@@ -10,16 +10,38 @@
  * We use a first fit policy when attempting to reuse a block 
  * from the free lists.
  * We always  insert free blocks to the free lists at the
- * beginning of the appropriate free list
+ * beginning of the appropriate free list, or in size order with
+ * -DSORTED_LISTS. Which end of a split block the payload goes to is
+ * picked at compile time with -DPLACEMENT (see seg_list_take)
  * structure of a free block is [Header][Previous][Next][empty/optional][Footer]
- * structure of allocated block is [Header][Payload][Footer]
+ * structure of allocated block is [Header][Payload]
+ * Only free blocks carry a footer. Besides its own allocated bit every
+ * header records whether the block right before it is allocated
+ * (PREV_ALLOC), which is all coalesce needs to know about an allocated
+ * neighbour; the footer of the previous block is only read when it is free.
+ *
+ * The heap state lives in an arena. By default there is one arena,
+ * grown through mem_sbrk; -DNUM_ARENAS=n adds mmap backed arenas that
+ * threads are spread over (see "Arenas" below).
+ * Building with -DTHREAD_SAFE puts every arena behind its own lock and
+ * adds a per-thread cache of small freed blocks in front of them (see
+ * "Thread-safe mode" below).
  */
+#define _GNU_SOURCE     /* sched_getcpu, mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
+
+#ifdef THREAD_SAFE
+#include <pthread.h>
+#endif
+#ifdef ARENA_BY_CPU
+#include <sched.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
@@ -54,32 +76,56 @@ team_t team = {
 #endif
 #define CHUNKSIZE   (1<<CHSIZE)      /* initial heap size (bytes) */
 
+// size classes are geometric: every power of two is split into
+// 1 << SIZE_CLASS_BITS classes (default one class per power of two)
+#ifndef SIZE_CLASS_BITS
+#define SIZE_CLASS_BITS 0
+#endif
+#define SIZE_CLASS_SUBS (1 << SIZE_CLASS_BITS)
+
 #ifndef NUM_LISTS
-#define NUM_LISTS 11
+#define NUM_LISTS (1 + 10 * SIZE_CLASS_SUBS)
 #endif
 
 #define MAX(x,y) ((x) > (y)?(x) :(y))
 #define MIN(x,y) ((x) < (y)?(x): (y))
-/* Pack a size and allocated bit into a word */
+/* Pack a size and allocated bits into a word */
 #define PACK(size, alloc) ((size) | (alloc))
 
+/* Allocated bits of a header */
+#define ALLOC       0x1     /* this block is allocated */
+#define PREV_ALLOC  0x2     /* the block before this one is allocated */
+#define MAPPED      0x4     /* the block has a mapping of its own */
+#define REALLOC_HOT 0x8     /* realloc has grown this block before */
+
+/* the low four bits of a size are only free with 16 byte alignment */
+_Static_assert(DSIZE >= 16, "REALLOC_HOT needs sizes aligned to 16 bytes");
+
 /* Read and write a word at address p */
 #define GET(p)          (*(uintptr_t *)(p))
 #define PUT(p,val)      (*(uintptr_t *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)     (GET(p) & ~(DSIZE - 1))
-#define GET_ALLOC(p)    (GET(p) & 0x1)
+#define GET_ALLOC(p)    (GET(p) & ALLOC)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Forget that realloc grew block bp, under the arena lock */
+#define CLEAR_REALLOC_HOT(bp) PUT(HDRP(bp), GET(HDRP(bp)) & ~REALLOC_HOT)
 
-/* Given block ptr bp, compute address of its header and footer */
+/* Given block ptr bp, compute address of its header and footer
+ * (only free blocks have a footer, and only its size is kept up to date) */
 #define HDRP(bp)        ((char *)(bp) - WSIZE)
 #define FTRP(bp)        ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks
+ * (PREV_BLKP is only valid when the previous block is free) */
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
-void* heap_listp = NULL;
+/* Set or clear the PREV_ALLOC bit in the header of block bp */
+#define SET_PREV_ALLOC(bp)   PUT(HDRP(bp), GET(HDRP(bp)) | PREV_ALLOC)
+#define CLEAR_PREV_ALLOC(bp) PUT(HDRP(bp), GET(HDRP(bp)) & ~PREV_ALLOC)
 
 /* Implementation data structures */
 typedef struct list_block {
@@ -87,59 +133,397 @@ typedef struct list_block {
     struct list_block *next;
 } list_block;
 
+/*************************************************************************
+ * Large blocks
+ * The last size class has no upper bound, so it can hold thousands of
+ * blocks of very different sizes. Instead of a list its blocks are kept
+ * in a treap ordered by (size, address): best fit and insertion take
+ * O(log n) and among blocks of the best size the lowest address wins.
+ * The priority of a node is a hash of its address. A node links to its
+ * parent too, so coalescing takes a block out without searching for
+ * it. Build with -DLARGE_TREE=0 to keep the last class in a list like
+ * the others.
+ *************************************************************************/
+#ifndef LARGE_TREE
+#define LARGE_TREE 1
+#endif
+#define TREE_CLASS (NUM_LISTS - 1)
+#if LARGE_TREE && NUM_LISTS < 2
+#error "LARGE_TREE needs NUM_LISTS >= 2, a tree node does not fit a minimum block"
+#endif
+
+typedef struct tree_block {
+    struct tree_block *left;
+    struct tree_block *right;
+    struct tree_block *parent;
+} tree_block;
+
 /* Implementation globals and macros */
-#define MIN_BLOCK_SIZE 2 * DSIZE
+#define MIN_BLOCK_SIZE (2 * DSIZE)
+
+// a block that realloc has grown before and now has to move gets slack
+// to grow into: asize >> REALLOC_SLACK_SHIFT bytes, at most
+// REALLOC_SLACK_MAX. The default shift of 0 gives 100% slack, 1 gives
+// 50% and so on. REALLOC_SLACK_MAX=0 turns slack off
+#ifndef REALLOC_SLACK_SHIFT
+#define REALLOC_SLACK_SHIFT 0
+#endif
+#ifndef REALLOC_SLACK_MAX
+#define REALLOC_SLACK_MAX (1 << 20)
+#endif
+// In thread-safe mode only a block whose last request was larger than
+// the thread caches take is marked REALLOC_HOT. A marked block is then
+// always freed under its arena lock, which drops the mark, and the
+// cache paths that run without the lock never write a header
+#ifdef THREAD_SAFE
+#define REALLOC_HOT_MIN TCACHE_MAX_SIZE
+#else
+#define REALLOC_HOT_MIN 0
+#endif
+
+// where the payload goes when a free block is split
+#define PLACE_HIGH      1   /* upper end, the fragment stays below */
+#define PLACE_LOW       2   /* lower end, the fragment stays above */
+#define PLACE_NEIGHBOUR 3   /* next to the following block if it is of similar size */
+#define PLACE_BINNED    4   /* large requests high, small requests low */
+#ifndef PLACEMENT
+#define PLACEMENT PLACE_HIGH
+#endif
+#ifndef PLACE_BIN_SIZE
+#define PLACE_BIN_SIZE 128  /* smallest block placed high by PLACE_BINNED */
+#endif
+
+/* Block size for a request of size bytes: payload plus header, aligned */
+#define ADJUST_SIZE(size) \
+    MAX(MIN_BLOCK_SIZE, DSIZE * (((size) + WSIZE + (DSIZE-1)) / DSIZE))
 
 // allow configuring debug via commandline -DDBG
 #ifndef DBG
 #define DBG_PRINT(...)       (void)NULL;
 #define DBG_ASSERT(expr)     (void)NULL;
-#define SEG_LIST_PRINT(...)  (void)NULL;
-#define DBG_PRINT_HEAP(...)  (void)NULL;
+#define SEG_LIST_PRINT(a)    (void)NULL;
+#define DBG_PRINT_HEAP(a)    (void)NULL;
 #else
 #define DBG_PRINT(...)       printf(__VA_ARGS__);
 #define DBG_ASSERT(expr)     assert(expr);
-#define SEG_LIST_PRINT(...)  seg_list_print(__VA_ARGS__);
-#define DBG_PRINT_HEAP(...)  print_heap(__VA_ARGS__);
+#define SEG_LIST_PRINT(a)    seg_list_print(a);
+#define DBG_PRINT_HEAP(a)    print_heap(a);
+#endif
+
+
+
+/*************************************************************************
+ * Arenas
+ * An arena is an independent heap: its own segregated lists, its own
+ * prologue/epilogue and its own region to grow into. Arena 0 is the
+ * classic heap grown through mem_sbrk. Building with -DNUM_ARENAS=n
+ * (n > 1) adds n-1 arenas, each living in an ARENA_SIZE aligned mmap
+ * region with the arena struct at its base, so the owner of any block
+ * outside the mem_sbrk heap is found by masking its address.
+ * Threads are bound to arenas round-robin on first use, or by the CPU
+ * they are running on with -DARENA_BY_CPU.
+ *************************************************************************/
+#ifndef NUM_ARENAS
+#define NUM_ARENAS 1
+#endif
+
+#define MAP_BITS    (int)(sizeof(unsigned long) * 8)
+#define MAP_WORDS   ((NUM_LISTS + MAP_BITS - 1) / MAP_BITS)
+#if NUM_LISTS > 64 * 64
+#error "the two level occupancy map covers at most 4096 lists"
+#endif
+
+#ifndef ARENA_SIZE
+#define ARENA_SIZE (1UL << 26)      /* reserved bytes per mmap arena */
+#endif
+#ifndef VA_BITS
+#define VA_BITS 47                  /* bits of a user space address */
+#endif
+// one bit per ARENA_SIZE window of the address space, set for the
+// windows that hold an arena. Mapped blocks lie in the others
+#define ARENA_WINDOWS ((1UL << VA_BITS) / ARENA_SIZE)
+#define ARENA_WINDOW(p) ((uintptr_t)(p) / ARENA_SIZE)
+
+/*************************************************************************
+ * Slab runs
+ * Requests of up to SLAB_MAX_SIZE bytes are served from slab runs
+ * instead of the free lists. A run is an allocated heap block whose
+ * payload is a SLAB_RUN_SIZE aligned page, carved by heap_memalign. The
+ * page starts with a slab_run struct and is otherwise cut into slots of
+ * one size (a multiple of DSIZE), so tiny objects carry no header. Free
+ * slots are tracked in a bitmap in the run. Every arena keeps a bitmap
+ * with one bit per page it spans telling which pages are runs, so on
+ * free the run of an object is its address rounded down to the page.
+ * Build with -DSLAB_MAX_SIZE=0 to turn slab runs off.
+ *************************************************************************/
+#ifndef SLAB_MAX_SIZE
+#define SLAB_MAX_SIZE 64            /* largest request (bytes) served by a run */
+#endif
+#ifndef SLAB_RUN_SIZE
+#define SLAB_RUN_SIZE 4096          /* bytes per run, a power of two */
+#endif
+
+/*************************************************************************
+ * Mapped blocks
+ * Requests of at least MMAP_THRESHOLD bytes bypass the arenas and get
+ * a mapping of their own, so a huge block neither grows a heap for good
+ * nor outlives its free: mm_free unmaps it and mm_realloc moves it with
+ * mremap instead of copying. The payload starts DSIZE into the mapping,
+ * behind a header holding the length of the mapping and the MAPPED bit.
+ * Such blocks lie outside the memlib heap, which mdriver rejects, so
+ * this is off (0) unless MMAP_THRESHOLD is given on the command line.
+ *************************************************************************/
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD 0
+#endif
+
+/*************************************************************************
+ * Trimming
+ * Free space at the top of an arena is given back by moving the
+ * epilogue down (arena_trim), and the pages of large free blocks in the
+ * middle of a heap are released with madvise while their header, list
+ * links and footer stay in place. memlib can't shrink the main heap, so
+ * there the trimmed room stays reserved and is reused by arena_sbrk
+ * before the heap grows again, but its pages are released all the same.
+ * mm_trim does both for every arena on request; free does them as a
+ * policy when the top block reaches TRIM_THRESHOLD bytes or another
+ * free block reaches RELEASE_THRESHOLD bytes (0 turns either off).
+ *************************************************************************/
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD 0                /* free top block size that triggers a trim */
+#endif
+#ifndef TRIM_PAD
+#define TRIM_PAD 0                      /* free bytes a trim leaves at the top */
+#endif
+#ifndef RELEASE_THRESHOLD
+#define RELEASE_THRESHOLD 0             /* free block size whose pages are released */
+#endif
+#ifndef RELEASE_ADVICE
+#define RELEASE_ADVICE MADV_DONTNEED    /* or MADV_FREE to release lazily */
+#endif
+
+/*************************************************************************
+ * Deferred coalescing (-DDEFER_COALESCE)
+ * Freed blocks of up to QUICK_MAX_SIZE bytes are pushed on a quick list
+ * of their exact size and stay marked as allocated, so they are neither
+ * coalesced nor put on the segregated lists. malloc of the same size
+ * pops them straight back. The quick lists are consolidated, that is
+ * every block on them is freed for real, when malloc finds no fit in
+ * the segregated lists or when they hold more than QUICK_LIMIT bytes.
+ *************************************************************************/
+#ifdef DEFER_COALESCE
+#ifndef QUICK_MAX_SIZE
+#define QUICK_MAX_SIZE 256          /* largest block size (bytes) kept in a quick list */
+#endif
+#ifndef QUICK_LIMIT
+#define QUICK_LIMIT (64 * 1024)     /* bytes held in quick lists before consolidating */
+#endif
+#define QUICK_BINS          (QUICK_MAX_SIZE / DSIZE - 1)
+#define QUICK_INDEX(size)   ((size) / DSIZE - 2)
+#endif
+
+#if SLAB_MAX_SIZE > 0
+#define SLAB_CLASSES        (SLAB_MAX_SIZE / DSIZE)
+#define SLAB_CLASS(size)    (((size) + DSIZE - 1) / DSIZE - 1)
+#define SLAB_MAP_WORDS      (SLAB_RUN_SIZE / DSIZE / MAP_BITS)
+#define SLAB_HDR_SIZE       (DSIZE * ((sizeof(slab_run) + DSIZE - 1) / DSIZE))
+#define SLAB_PAGES          (ARENA_SIZE / SLAB_RUN_SIZE)
+
+typedef struct slab_run {
+    // runs of one class that have a free slot
+    struct slab_run *prev;
+    struct slab_run *next;
+    unsigned size;              /* slot size */
+    unsigned nslots;
+    unsigned nfree;
+    // bit i is set iff slot i is free
+    unsigned long map[SLAB_MAP_WORDS];
+} slab_run;
+#endif
+
+typedef struct arena {
+    // segregated lists of different size classes
+    list_block *seg_lists[NUM_LISTS];
+    // occupancy map of seg_lists, one bit per list and one summary
+    // bit per word of the map
+    unsigned long seg_map[MAP_WORDS];
+    unsigned long seg_map_top;
+#if LARGE_TREE
+    // the blocks of the last class, seg_lists[TREE_CLASS] stays empty
+    tree_block *tree;
+#endif
+    void* heap_listp;
+    void* prologue;
+    void* epilogue;
+    /* used for debugging */
+    void* start_of_heap;
+    /* heap top and end of the reserved region (mmap arenas only) */
+    char* brk;
+    char* limit;
+#if SLAB_MAX_SIZE > 0
+    // runs with free slots per slot size, and which pages are runs
+    // counting from slab_base
+    slab_run *slab_runs[SLAB_CLASSES];
+    char* slab_base;
+    unsigned long slab_pages[SLAB_PAGES / MAP_BITS];
+#endif
+    // realloc outcomes and lock counts, summed up by mm_get_stats
+    mm_stats_t stats;
+#ifdef DEFER_COALESCE
+    // freed blocks waiting to be coalesced, by exact size
+    list_block *quick[QUICK_BINS];
+    size_t quick_bytes;
+#endif
+#ifdef THREAD_SAFE
+    pthread_mutex_t lock;
+#endif
+} arena;
+
+#ifdef THREAD_SAFE
+arena main_arena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+// counts how often the lock was held by another thread, see mm_get_stats
+#define ARENA_LOCK(a)   do {                            \
+        if (pthread_mutex_trylock(&(a)->lock) != 0) {   \
+            pthread_mutex_lock(&(a)->lock);             \
+            (a)->stats.lock_contended++;                \
+        }                                               \
+        (a)->stats.lock_acquired++;                     \
+    } while (0)
+#define ARENA_UNLOCK(a) pthread_mutex_unlock(&(a)->lock)
+#else
+arena main_arena;
+#define ARENA_LOCK(a)   (void)NULL
+#define ARENA_UNLOCK(a) (void)NULL
+#endif
+
+int arena_check(arena *a);
+
+#if NUM_ARENAS > 1
+arena *arenas[NUM_ARENAS] = { &main_arena };
+unsigned next_arena = 0;
+__thread arena *thread_arena = NULL;
+#ifdef THREAD_SAFE
+pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+#if MMAP_THRESHOLD > 0
+unsigned long arena_windows[(ARENA_WINDOWS + MAP_BITS - 1) / MAP_BITS];
+#endif
+#endif
+
+/*************************************************************************
+ * Thread-safe mode (-DTHREAD_SAFE)
+ * Every arena is guarded by its own lock. In front of the arenas every
+ * thread owns a cache of small freed blocks, binned by exact block size,
+ * so a malloc that follows a free of the same size never takes a lock.
+ * Cached blocks stay marked as allocated and are therefore never
+ * coalesced. Blocks go back to their arenas TCACHE_BATCH at a time when a
+ * bin overflows (or when the thread exits), so blocks freed by a thread
+ * other than the one that allocated them are returned in batches rather
+ * than one lock acquisition per free.
+ *************************************************************************/
+#ifdef THREAD_SAFE
+const int mm_thread_safe = 1;
+#else
+const int mm_thread_safe = 0;
+#endif
+
+#ifdef THREAD_SAFE
+
+#ifndef TCACHE_MAX_SIZE
+#define TCACHE_MAX_SIZE 512     /* largest block size (bytes) kept in a cache */
+#endif
+#ifndef TCACHE_COUNT
+#define TCACHE_COUNT 32         /* blocks per bin before it is flushed */
+#endif
+#ifndef TCACHE_BATCH
+#define TCACHE_BATCH 16         /* blocks handed back to the heap per flush */
 #endif
 
+/* one bin per block size from MIN_BLOCK_SIZE to TCACHE_MAX_SIZE */
+#define TCACHE_BINS         (TCACHE_MAX_SIZE / DSIZE - 1)
+#define TCACHE_INDEX(size)  ((size) / DSIZE - 2)
+#if SLAB_MAX_SIZE > 0
+/* followed by one bin per slab slot size, indexed by request size */
+#define TCACHE_SLAB_INDEX(size) (TCACHE_BINS + SLAB_CLASS(size))
+#define TCACHE_ALL_BINS     (TCACHE_BINS + SLAB_CLASSES)
+#else
+#define TCACHE_ALL_BINS     TCACHE_BINS
+#endif
 
+typedef struct tcache_bin {
+    list_block *head;           /* singly linked through list_block.next */
+    int count;
+} tcache_bin;
 
-// Global segregated lists of different size classes
-list_block *seg_lists[NUM_LISTS];
+typedef struct tcache {
+    unsigned gen;               /* heap_gen the cached blocks belong to */
+    int registered;             /* exit destructor has been set up */
+    tcache_bin bins[TCACHE_ALL_BINS];
+} tcache;
 
-/* used for debugging */
-void* epilogue = NULL;
-void* start_of_heap = NULL;
+pthread_key_t tcache_key;
+pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+__thread tcache thread_cache;
 
-void* prologue = NULL;
+/* bumped by mm_init so caches filled from an older heap are dropped */
+unsigned heap_gen = 0;
+#endif
 
 /* Implementation functions */
-void seg_list_init(void) {
+void seg_list_init(arena *a) {
     int i;
     for(i = 0; i < NUM_LISTS; i++) {
-        seg_lists[i] = NULL;
+        a->seg_lists[i] = NULL;
     }
+    memset(a->seg_map, 0, sizeof(a->seg_map));
+    a->seg_map_top = 0;
+#if LARGE_TREE
+    a->tree = NULL;
+#endif
+}
+
+/**********************************************************
+ * mark_free / mark_alloc
+ * Give block bp a size and an allocation state, keeping
+ * its PREV_ALLOC bit and the PREV_ALLOC bit of the block
+ * that follows it in sync. Free blocks get a footer,
+ * allocated blocks don't
+ **********************************************************/
+void mark_free(void *bp, size_t size) {
+    uintptr_t word = PACK(size, GET_PREV_ALLOC(HDRP(bp)));
+    PUT(HDRP(bp), word);
+    PUT(FTRP(bp), word);
+    CLEAR_PREV_ALLOC(NEXT_BLKP(bp));
+}
+
+void mark_alloc(void *bp, size_t size) {
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | ALLOC));
+    SET_PREV_ALLOC(NEXT_BLKP(bp));
 }
 
-// TODO(Zen): Improve from O(n) -> O(1)
-// I don't think that can be done, best we can do is O(logn)
-// by doing a binary search to find the appropriate list
-// But it's actually already O(1) because NUM LISTS is a constant
 /**********************************************************
  * calc_size_class
  * find the ideal free list to which a block of a given
  * size should belong
+ * Class 0 holds blocks up to MIN_BLOCK_SIZE, after that
+ * each power of two (MIN_BLOCK_SIZE << e, MIN_BLOCK_SIZE << (e+1)]
+ * is split into SIZE_CLASS_SUBS equal classes. The class is
+ * computed from the leading bit of the size and the
+ * SIZE_CLASS_BITS bits below it, so it takes constant time
  **********************************************************/
 int calc_size_class(size_t sz) {
     DBG_ASSERT(sz >= MIN_BLOCK_SIZE);
     DBG_ASSERT(sz % 16 == 0);
 
-    int i = 0, bucket_sz = MIN_BLOCK_SIZE;
-    while(sz > bucket_sz && i < NUM_LISTS) {
-        bucket_sz = bucket_sz << 1;
-        i++;
-    }
+    // sz-1 in units of the smallest sub-class
+    size_t w = (sz - 1) / (MIN_BLOCK_SIZE / SIZE_CLASS_SUBS);
+    if (w < SIZE_CLASS_SUBS)
+        return 0;
+
+    // position of the leading bit, the bits below it pick the sub-class
+    int msb = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(w);
+    int e = msb - SIZE_CLASS_BITS;
+    int i = 1 + (e << SIZE_CLASS_BITS) + ((w >> e) & (SIZE_CLASS_SUBS - 1));
 
     return MIN(i, NUM_LISTS - 1);
 }
@@ -149,19 +533,187 @@ int calc_size_class(size_t sz) {
  * seg_list_print
  * print every block in every free list
  **********************************************************/
-void seg_list_print(void) {
+void seg_list_print(arena *a) {
     int i;
     for (i = 0; i < NUM_LISTS; i++) {
         DBG_PRINT("printing seg_lists[%d]\n", i);
-        list_block *ls = seg_lists[i];
+        list_block *ls = a->seg_lists[i];
         if (!ls) continue;
         do {
             DBG_PRINT("\tblock of size: %lu @ 0x%p\n", GET_SIZE(HDRP((void*)ls)), (void*)ls);
             ls = ls->next;
-        } while (ls != seg_lists[i]); 
+        } while (ls != a->seg_lists[i]); 
+    }
+#if LARGE_TREE
+    DBG_PRINT("tree of seg_lists[%d] @ 0x%p\n", TREE_CLASS, (void*)a->tree);
+#endif
+}
+
+/**********************************************************
+ * seg_map_set / seg_map_clear
+ * keep the occupancy map of an arena in sync with its lists
+ * bit i of seg_map is set iff seg_lists[i] is not empty,
+ * bit w of seg_map_top is set iff seg_map[w] is not zero
+ **********************************************************/
+void seg_map_set(arena *a, int sz_cls) {
+    int w = sz_cls / MAP_BITS;
+    a->seg_map[w] |= 1UL << (sz_cls % MAP_BITS);
+    a->seg_map_top |= 1UL << w;
+}
+
+void seg_map_clear(arena *a, int sz_cls) {
+    int w = sz_cls / MAP_BITS;
+    a->seg_map[w] &= ~(1UL << (sz_cls % MAP_BITS));
+    if (!a->seg_map[w]) {
+        a->seg_map_top &= ~(1UL << w);
+    }
+}
+
+/**********************************************************
+ * seg_map_next
+ * first non-empty size class >= sz_cls, or -1 if there is
+ * none. Two find-first-set operations at most
+ **********************************************************/
+int seg_map_next(arena *a, int sz_cls) {
+    if (sz_cls >= NUM_LISTS) return -1;
+
+    int w = sz_cls / MAP_BITS;
+    unsigned long bits = a->seg_map[w] & (~0UL << (sz_cls % MAP_BITS));
+    if (bits) {
+        return w * MAP_BITS + __builtin_ctzl(bits);
+    }
+
+    // no luck in this word, find the next word that has a bit set
+    unsigned long words = (w + 1 < MAP_BITS) ? a->seg_map_top & (~0UL << (w + 1)) : 0;
+    if (!words) return -1;
+    w = __builtin_ctzl(words);
+    return w * MAP_BITS + __builtin_ctzl(a->seg_map[w]);
+}
+
+#if LARGE_TREE
+/**********************************************************
+ * tree_prio / tree_less
+ * The heap priority of a node, and the (size, address)
+ * order of the tree
+ **********************************************************/
+unsigned long tree_prio(tree_block *t) {
+    return ((uintptr_t)t >> 4) * 0x9e3779b97f4a7c15UL;
+}
+
+int tree_less(tree_block *x, tree_block *y) {
+    size_t sx = GET_SIZE(HDRP(x)), sy = GET_SIZE(HDRP(y));
+    return sx < sy || (sx == sy && x < y);
+}
+
+/**********************************************************
+ * tree_split / tree_merge
+ * Split treap t into the nodes before key and the nodes
+ * after it, as children of key, and merge two treaps whose
+ * nodes are all in order back into one under parent
+ **********************************************************/
+void tree_split(tree_block *t, tree_block *key, tree_block **l, tree_block **r) {
+    tree_block *lp = key, *rp = key;
+    while (t) {
+        if (tree_less(t, key)) {
+            *l = t;
+            t->parent = lp;
+            lp = t;
+            l = &t->right;
+            t = t->right;
+        } else {
+            *r = t;
+            t->parent = rp;
+            rp = t;
+            r = &t->left;
+            t = t->left;
+        }
+    }
+    *l = *r = NULL;
+}
+
+tree_block *tree_merge(tree_block *l, tree_block *r, tree_block *parent) {
+    tree_block *root, **link = &root;
+    while (l && r) {
+        if (tree_prio(l) > tree_prio(r)) {
+            *link = l;
+            l->parent = parent;
+            parent = l;
+            link = &l->right;
+            l = l->right;
+        } else {
+            *link = r;
+            r->parent = parent;
+            parent = r;
+            link = &r->left;
+            r = r->left;
+        }
+    }
+    *link = l ? l : r;
+    if (*link)
+        (*link)->parent = parent;
+    return root;
+}
+
+/**********************************************************
+ * tree_insert / tree_remove
+ * Add a free block of the last class to the tree of an
+ * arena, or take it out. The size of a block must not
+ * change while it is in the tree
+ **********************************************************/
+void tree_insert(arena *a, tree_block *blk) {
+    tree_block **link = &a->tree, *parent = NULL;
+    unsigned long prio = tree_prio(blk);
+    if (!a->tree)
+        seg_map_set(a, TREE_CLASS);
+    while (*link && tree_prio(*link) > prio) {
+        parent = *link;
+        link = tree_less(blk, *link) ? &(*link)->left : &(*link)->right;
+    }
+    tree_split(*link, blk, &blk->left, &blk->right);
+    blk->parent = parent;
+    *link = blk;
+}
+
+void tree_remove(arena *a, tree_block *blk) {
+    tree_block *p = blk->parent;
+    tree_block **link = !p ? &a->tree : p->left == blk ? &p->left : &p->right;
+    *link = tree_merge(blk->left, blk->right, p);
+    if (!a->tree)
+        seg_map_clear(a, TREE_CLASS);
+}
+
+/**********************************************************
+ * tree_best_fit
+ * The smallest block of at least sz bytes, the lowest one
+ * of that size, or NULL. It stays in the tree
+ **********************************************************/
+tree_block *tree_best_fit(arena *a, size_t sz) {
+    tree_block *t = a->tree, *best = NULL;
+    while (t) {
+        if (GET_SIZE(HDRP(t)) >= sz) {
+            best = t;
+            t = t->left;
+        } else {
+            t = t->right;
+        }
     }
+    return best;
+}
+
+/**********************************************************
+ * tree_release
+ * block_release every block of a tree
+ **********************************************************/
+void block_release(void *bp);
 
+void tree_release(tree_block *t) {
+    while (t) {
+        tree_release(t->left);
+        block_release(t);
+        t = t->right;
+    }
 }
+#endif
 
 /**********************************************************
  * seg_list_add
@@ -169,49 +721,73 @@ void seg_list_print(void) {
  * the block is always inserted at 
  * the head of the appropriate list
  **********************************************************/
-void seg_list_add(list_block* bp) {
+void seg_list_add(arena *a, list_block* bp) {
     int bsize = GET_SIZE(HDRP(bp));
     // Get the size class for block of bsize;
     int sz_cls = calc_size_class(bsize);
-    list_block *list = seg_lists[sz_cls];
+    list_block *list = a->seg_lists[sz_cls];
+#if LARGE_TREE
+    if (sz_cls == TREE_CLASS) {
+        tree_insert(a, (tree_block*)bp);
+        return;
+    }
+#endif
 
 
-    DBG_ASSERT(GET(HDRP(bp)) == GET(FTRP(bp)));
+    DBG_ASSERT(GET_SIZE(HDRP(bp)) == GET_SIZE(FTRP(bp)));
     DBG_ASSERT(bsize >= 2*DSIZE);
 
     DBG_PRINT("Inserting to seg_lists[%d] @ 0x%p, block size: %d\n", sz_cls, (void*)list, bsize);
     if (!list) {
         DBG_PRINT("list@%d is empty!!\n", sz_cls);
-        seg_lists[sz_cls] = bp;
+        a->seg_lists[sz_cls] = bp;
+        seg_map_set(a, sz_cls);
         bp->next = bp;
         bp->prev = bp;
-        SEG_LIST_PRINT();
+        SEG_LIST_PRINT(a);
         return;
     }
 
-    // seg list is not empty, insert bp at head
-    bp->next = seg_lists[sz_cls];
-    bp->prev = seg_lists[sz_cls]->prev;
+#ifdef SORTED_LISTS
+    // keep the list in increasing size order, so first fit is best fit
+    while (GET_SIZE(HDRP(list)) < bsize) {
+        list = list->next;
+        if (list == a->seg_lists[sz_cls]) break;
+    }
+    if (list == a->seg_lists[sz_cls] && GET_SIZE(HDRP(list)) >= bsize) {
+        a->seg_lists[sz_cls] = bp;
+    }
+#endif
+    // seg list is not empty, insert bp in front of list, which is
+    // the end of the circular list unless the lists are sorted
+    bp->next = list;
+    bp->prev = list->prev;
     bp->prev->next = bp;
     bp->next->prev = bp;
-    SEG_LIST_PRINT();
+    SEG_LIST_PRINT(a);
 }
 
 /**********************************************************
  * seg_list_remove
  * remove a block from the free lists
  **********************************************************/
-void seg_list_remove(list_block* blk) {
+void seg_list_remove(arena *a, list_block* blk) {
     if (!blk) return;
     size_t sz = GET_SIZE(HDRP(blk));
 
     DBG_ASSERT(FTRP(blk) > HDRP(blk));
     DBG_PRINT("blk at %p, header = %p, footer = %p\n", blk,*((unsigned long*) HDRP(blk)),*((unsigned long*)FTRP(blk)));
     DBG_PRINT("size from header = %d,size from footer = %d\n", GET_SIZE(HDRP(blk)), GET_SIZE(FTRP(blk)));
-    DBG_ASSERT(GET(HDRP(blk)) == GET(FTRP(blk)));
+    DBG_ASSERT(GET_SIZE(HDRP(blk)) == GET_SIZE(FTRP(blk)));
 
     int sz_cls = calc_size_class(sz);
     DBG_ASSERT(sz >= 2*DSIZE);
+#if LARGE_TREE
+    if (sz_cls == TREE_CLASS) {
+        tree_remove(a, (tree_block*)blk);
+        return;
+    }
+#endif
     if (blk != blk->next) {
         if (blk->prev && blk->next) {
             blk->prev->next = blk->next;
@@ -219,90 +795,330 @@ void seg_list_remove(list_block* blk) {
         }
         
         // if blk is the head of the list
-        if (blk == seg_lists[sz_cls]) {
-            seg_lists[sz_cls] = blk->next;
+        if (blk == a->seg_lists[sz_cls]) {
+            a->seg_lists[sz_cls] = blk->next;
         }
 
         return;
     }
 
-    seg_lists[sz_cls] = NULL;
+    a->seg_lists[sz_cls] = NULL;
+    seg_map_clear(a, sz_cls);
 }
 
 /**********************************************************
- * seg_list_find_split_place
- * finds a block (on a first fit policy) big enough for sz
- * splits it of possible
- * places userload on higher part of the old block
- * (rem size forms the lower block) 
+ * split_high
+ * Decide whether the payload of a split goes to the higher
+ * part of free block blk (next to the block that follows
+ * it) or to the lower part, according to PLACEMENT.
+ * The block before a free block is always allocated and
+ * has no footer, so only the size of the following block
+ * is known to PLACE_NEIGHBOUR
+ **********************************************************/
+int split_high(list_block *blk, size_t sz) {
+#if PLACEMENT == PLACE_LOW
+    return 0;
+#elif PLACEMENT == PLACE_NEIGHBOUR
+    // group blocks of similar size together
+    size_t next_sz = GET_SIZE(HDRP(NEXT_BLKP(blk)));
+    return 2 * sz >= next_sz && sz <= 2 * next_sz;
+#elif PLACEMENT == PLACE_BINNED
+    return sz >= PLACE_BIN_SIZE;
+#else
+    return 1;
+#endif
+}
+
+/**********************************************************
+ * seg_list_take
+ * remove a free block of at least sz bytes from the lists
+ * splits it if possible
+ * places userload on the higher or lower part of the old
+ * block as split_high decides, the rest forms a free block
  * returns pointer to user load block
  **********************************************************/
-void * seg_list_find_fit(size_t sz) {
-    int sz_cls;
-    for(sz_cls = calc_size_class(sz); sz_cls < NUM_LISTS; sz_cls++) {
-        list_block *blk = seg_lists[sz_cls];
-        if (!blk) continue;
+void * seg_list_take(arena *a, list_block *blk, size_t sz) {
+    size_t blk_sz = GET_SIZE(HDRP(blk));
+    size_t rem_size = blk_sz - sz;
+    DBG_ASSERT(blk_sz >= sz);
+
+    // Remove block from current size_class
+    seg_list_remove(a, blk);
+
+    // Can't be split to produce another free block
+    if (rem_size < MIN_BLOCK_SIZE) {
+        return (void*)blk;
+    }
+
+    if (!split_high(blk, sz)) {
+        // payload at the bottom, the fragment above it is free
+        PUT(HDRP(blk), PACK(sz, GET_PREV_ALLOC(HDRP(blk)) | ALLOC));
+        void *rem = NEXT_BLKP(blk);
+        PUT(HDRP(rem), PACK(rem_size, PREV_ALLOC));
+        mark_free(rem, rem_size);
+        seg_list_add(a, (list_block*)rem);
+        return (void*)blk;
+    }
+    
+    // Split block and put excess fragment into appropriate size class
+    // the fragment right below the payload is free
+    void* usrptr = (void*)blk + rem_size;
+    PUT(HDRP(usrptr), PACK(sz, ALLOC));
+    SET_PREV_ALLOC(NEXT_BLKP(usrptr));
+
+    // Mark next block of size rem_size as empty and add to seg_list
+    mark_free(blk, rem_size);
+    DBG_ASSERT(FTRP(blk) > HDRP(blk));
+    seg_list_add(a, (list_block*)blk);
+    
+    return usrptr;
+}
+
+/**********************************************************
+ * seg_list_find_fit
+ * finds a block (on a first fit policy) big enough for sz
+ * and takes it out of the free lists with seg_list_take
+ * Only the class of sz itself can hold blocks that are too
+ * small. Every block in a higher class fits, so after that
+ * class the occupancy map gives the first non-empty one
+ * directly. With -DBOUNDED_FIT only the head of the class
+ * of sz is looked at, which bounds the search to a few
+ * bit scans (TLSF style good fit). The last class has no
+ * higher class to fall back on and is always searched
+ **********************************************************/
+void * seg_list_find_fit(arena *a, size_t sz) {
+    int sz_cls = calc_size_class(sz);
+    list_block *blk = a->seg_lists[sz_cls];
+#if LARGE_TREE
+    tree_block *t;
+    if (sz_cls == TREE_CLASS)
+        return (t = tree_best_fit(a, sz)) ? seg_list_take(a, (list_block*)t, sz) : NULL;
+#endif
+
+    if (blk) {
         do {
-            size_t blk_sz = GET_SIZE(HDRP(blk));
             // Search for blocks that are >= sz
-            if (blk_sz < sz) {
-                blk = blk->next;
-                continue;
+            if (GET_SIZE(HDRP(blk)) >= sz) {
+                return seg_list_take(a, blk, sz);
             }
+            blk = blk->next;
+#ifdef BOUNDED_FIT
+        } while (sz_cls == NUM_LISTS - 1 && blk != a->seg_lists[sz_cls]);
+#else
+        } while (blk != a->seg_lists[sz_cls]); 
+#endif
+    }
 
-            size_t rem_size = blk_sz - sz;
-            //TODO(Zen): Remove repeated code (repeated in place)
-            // Can't be split to produce another free block
-            if (rem_size < MIN_BLOCK_SIZE) {
-                seg_list_remove(blk);
-                return (void*)blk;
-            }
-            
-            // Split block and put excess fragment into appropriate size class
-            // Remove block from current size_class
-            seg_list_remove(blk);
-            void* usrptr = (void*)blk + rem_size;
-            PUT(HDRP(usrptr), PACK(sz, 1));
-            PUT(FTRP(usrptr), PACK(sz, 1)); 
-            DBG_ASSERT(FTRP(blk) > HDRP(blk));
-
-            // Mark next block of size rem_size as empty and add to seg_list
-            PUT(HDRP(blk), PACK(rem_size, 0));
-            PUT(FTRP(blk), PACK(rem_size, 0));
-            seg_list_add((list_block*)blk);
-            
-            return usrptr;
-        } while (blk != seg_lists[sz_cls]); 
+    if (sz_cls == NUM_LISTS - 1 || (sz_cls = seg_map_next(a, sz_cls + 1)) < 0) {
+        return NULL;
     }
+#if LARGE_TREE
+    // every block in the tree fits, take the smallest
+    if (sz_cls == TREE_CLASS)
+        return seg_list_take(a, (list_block*)tree_best_fit(a, sz), sz);
+#endif
+    return seg_list_take(a, a->seg_lists[sz_cls], sz);
+}
 
-    return NULL;
+/**********************************************************
+ * arena_sbrk
+ * Grow the heap of an arena by incr bytes, returns the old
+ * top of the heap or (void *)-1 when it is out of room
+ **********************************************************/
+void *arena_sbrk(arena *a, size_t incr)
+{
+    if (a == &main_arena) {
+        // room given back by a trim is reused before memlib grows
+        char *top = (char*)mem_heap_hi() + 1;
+        if (a->brk + incr > top && mem_sbrk(a->brk + incr - top) == (void *)-1)
+            return (void *)-1;
+    } else if (a->brk + incr > a->limit) {
+        return (void *)-1;
+    }
+    void *old_brk = a->brk;
+    a->brk += incr;
+    return old_brk;
 }
 
 /**********************************************************
- * mm_init
- * Initialize the heap, including "allocation" of the
- * prologue and epilogue
+ * arena_init
+ * Initialize the heap of an arena, including "allocation"
+ * of the prologue and epilogue
  **********************************************************/
- int mm_init(void)
- {
-     DBG_PRINT("using NUM_LISTS=%d, CHSIZE=%d\n",NUM_LISTS,CHSIZE);
-     if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1)
+int arena_init(arena *a)
+{
+     if (a != &main_arena)
+         a->brk = (char*)a + DSIZE * ((sizeof(arena) + DSIZE - 1) / DSIZE);
+     else
+         a->brk = (char*)mem_heap_hi() + 1;
+
+     if ((a->heap_listp = arena_sbrk(a, 4*WSIZE)) == (void *)-1)
          return -1;
 
-     start_of_heap = heap_listp;
+     a->start_of_heap = a->heap_listp;
 
-     PUT(heap_listp, 0);                         // alignment padding
-     PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1));   // prologue header
-     PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1));   // prologue footer
+     PUT(a->heap_listp, 0);                         // alignment padding
+     PUT(a->heap_listp + (1 * WSIZE), PACK(DSIZE, PREV_ALLOC | ALLOC));   // prologue header
+     PUT(a->heap_listp + (2 * WSIZE), PACK(DSIZE, PREV_ALLOC | ALLOC));   // prologue footer
 
-     prologue = (void*) (heap_listp + (2 * WSIZE));
+     a->prologue = (void*) (a->heap_listp + (2 * WSIZE));
 
-     PUT(heap_listp + (3 * WSIZE), PACK(0, 1));    // epilogue header
-     heap_listp += DSIZE;
-     
-     seg_list_init();
+     PUT(a->heap_listp + (3 * WSIZE), PACK(0, PREV_ALLOC | ALLOC));    // epilogue header
+     a->heap_listp += DSIZE;
+     a->epilogue = a->heap_listp + DSIZE;
+
+     seg_list_init(a);
+     memset(&a->stats, 0, sizeof(a->stats));
+#if SLAB_MAX_SIZE > 0
+     memset(a->slab_runs, 0, sizeof(a->slab_runs));
+     memset(a->slab_pages, 0, sizeof(a->slab_pages));
+     a->slab_base = (char*)((uintptr_t)a->start_of_heap & ~(uintptr_t)(SLAB_RUN_SIZE - 1));
+#endif
+#ifdef DEFER_COALESCE
+     memset(a->quick, 0, sizeof(a->quick));
+     a->quick_bytes = 0;
+#endif
      return 0;
- }
+}
+
+#if NUM_ARENAS > 1
+/**********************************************************
+ * arena_new
+ * Map an ARENA_SIZE aligned region and set up an arena
+ * at its base
+ **********************************************************/
+arena *arena_new(void)
+{
+    // map twice the size so an aligned region fits, then unmap the slack
+    char *raw = mmap(NULL, 2 * ARENA_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+    char *base = (char*)(((uintptr_t)raw + ARENA_SIZE - 1) & ~(ARENA_SIZE - 1));
+    if (base != raw)
+        munmap(raw, base - raw);
+    munmap(base + ARENA_SIZE, raw + ARENA_SIZE - base);
+#if MMAP_THRESHOLD > 0
+    // arena_of only knows the windows below 2^VA_BITS
+    if (ARENA_WINDOW(base) >= ARENA_WINDOWS) {
+        munmap(base, ARENA_SIZE);
+        return NULL;
+    }
+#endif
+
+    arena *a = (arena*)base;
+    a->limit = base + ARENA_SIZE;
+#ifdef THREAD_SAFE
+    pthread_mutex_init(&a->lock, NULL);
+#endif
+    if (arena_init(a) < 0) {
+        munmap(base, ARENA_SIZE);
+        return NULL;
+    }
+    return a;
+}
+
+/**********************************************************
+ * arena_at
+ * Return arena i, creating it on first use. Falls back
+ * to the main arena if no region can be mapped
+ **********************************************************/
+arena *arena_at(int i)
+{
+    arena *a = __atomic_load_n(&arenas[i], __ATOMIC_ACQUIRE);
+    if (a)
+        return a;
+#ifdef THREAD_SAFE
+    pthread_mutex_lock(&arenas_lock);
+#endif
+    if ((a = arenas[i]) == NULL && (a = arena_new()) != NULL) {
+#if MMAP_THRESHOLD > 0
+        size_t w = ARENA_WINDOW(a);
+        __atomic_fetch_or(&arena_windows[w / MAP_BITS], 1UL << (w % MAP_BITS), __ATOMIC_RELAXED);
+#endif
+        __atomic_store_n(&arenas[i], a, __ATOMIC_RELEASE);
+    }
+#ifdef THREAD_SAFE
+    pthread_mutex_unlock(&arenas_lock);
+#endif
+    return a ? a : &main_arena;
+}
+#endif
+
+/**********************************************************
+ * arena_get
+ * The arena the calling thread allocates from
+ **********************************************************/
+arena *arena_get(void)
+{
+#if NUM_ARENAS > 1
+#ifdef ARENA_BY_CPU
+    int cpu = sched_getcpu();
+    return arena_at(cpu < 0 ? 0 : cpu % NUM_ARENAS);
+#else
+    if (thread_arena == NULL)
+        thread_arena = arena_at(__atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % NUM_ARENAS);
+    return thread_arena;
+#endif
+#else
+    return &main_arena;
+#endif
+}
+
+/**********************************************************
+ * arena_of
+ * The arena that owns block bp, in constant time, or
+ * NULL for a mapped block
+ **********************************************************/
+arena *arena_of(void *bp)
+{
+#if NUM_ARENAS > 1 || MMAP_THRESHOLD > 0
+    if ((char*)bp >= (char*)mem_heap_lo() && (char*)bp <= (char*)mem_heap_hi())
+        return &main_arena;
+#endif
+#if NUM_ARENAS > 1
+    arena *a = (arena*)((uintptr_t)bp & ~(ARENA_SIZE - 1));
+#if MMAP_THRESHOLD > 0
+    // a mapped block lies in none of the arena windows. The bit of
+    // the window a block was allocated in was set before the arena was
+    // handed out, so it is seen by whoever frees the block
+    size_t w = ARENA_WINDOW(bp);
+    if (w >= ARENA_WINDOWS ||
+        !((__atomic_load_n(&arena_windows[w / MAP_BITS], __ATOMIC_RELAXED) >> (w % MAP_BITS)) & 1))
+        return NULL;
+    return a;
+#else
+    return a;
+#endif
+#elif MMAP_THRESHOLD > 0
+    return NULL;
+#else
+    return &main_arena;
+#endif
+}
+
+/**********************************************************
+ * mm_init
+ * Initialize the main heap, and reset every other arena
+ * that was created so far
+ **********************************************************/
+int mm_init(void)
+{
+    DBG_PRINT("using NUM_LISTS=%d, CHSIZE=%d\n",NUM_LISTS,CHSIZE);
+    if (arena_init(&main_arena) < 0)
+        return -1;
+#if NUM_ARENAS > 1
+    int i;
+    for (i = 1; i < NUM_ARENAS; i++) {
+        if (arenas[i] && arena_init(arenas[i]) < 0)
+            return -1;
+    }
+#endif
+#ifdef THREAD_SAFE
+    heap_gen++;
+#endif
+    return 0;
+}
 
 /**********************************************************
  * coalesce
@@ -312,61 +1128,54 @@ void * seg_list_find_fit(size_t sz) {
  * - the previous block is available for coalescing
  * - both neighbours are available for coalescing
  **********************************************************/
-void *coalesce(void *bp)
+void *coalesce(arena *a, void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
     DBG_ASSERT(FTRP(bp) > HDRP(bp));
-    DBG_ASSERT(FTRP(PREV_BLKP(bp)) > HDRP(PREV_BLKP(bp)));
-
-    if(NEXT_BLKP(bp) != epilogue){
-        DBG_PRINT("blk at %p\n",NEXT_BLKP(bp));
-        DBG_ASSERT(FTRP(NEXT_BLKP(bp)) > HDRP(NEXT_BLKP(bp)));
-    }
+    DBG_ASSERT(GET_SIZE(HDRP(bp)) == GET_SIZE(FTRP(bp)));
 
     if (prev_alloc && next_alloc) {       /* Case 1 */
         return bp;
     }
 
     else if (prev_alloc && !next_alloc) { /* Case 2 */
-        seg_list_remove((list_block*)NEXT_BLKP(bp));
+        seg_list_remove(a, (list_block*)NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
         DBG_ASSERT(FTRP(bp) > HDRP(bp));
-        DBG_ASSERT(bp > start_of_heap);
+        DBG_ASSERT(bp > a->start_of_heap);
         return (bp);
     }
 
+    // a free block always follows an allocated one, so the merged
+    // block starting at the previous block has PREV_ALLOC set
     else if (!prev_alloc && next_alloc) { /* Case 3 */
-        seg_list_remove((list_block*)PREV_BLKP(bp));
+        seg_list_remove(a, (list_block*)PREV_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
 
         DBG_ASSERT(FTRP(bp) > HDRP(bp));
         DBG_ASSERT(FTRP(PREV_BLKP(bp)) > HDRP(PREV_BLKP(bp)));
 
-        DBG_ASSERT((void*)PREV_BLKP(bp) > start_of_heap);
+        DBG_ASSERT((void*)PREV_BLKP(bp) > a->start_of_heap);
         return (PREV_BLKP(bp));
     }
 
     else {            /* Case 4 */
-        seg_list_remove((list_block*)PREV_BLKP(bp));
-        seg_list_remove((list_block*)NEXT_BLKP(bp));
+        seg_list_remove(a, (list_block*)PREV_BLKP(bp));
+        seg_list_remove(a, (list_block*)NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp)))  +
             GET_SIZE(FTRP(NEXT_BLKP(bp)))  ;
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size,0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size,0));
-
-        if(NEXT_BLKP(bp) != epilogue)
-        DBG_ASSERT(FTRP(NEXT_BLKP(bp)) > HDRP(NEXT_BLKP(bp)));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, PREV_ALLOC));
 
         DBG_ASSERT(FTRP(PREV_BLKP(bp)) > HDRP(PREV_BLKP(bp)));
-        DBG_ASSERT(FTRP(bp) > HDRP(bp));
 
-        DBG_ASSERT((void*)PREV_BLKP(bp) > start_of_heap);
+        DBG_ASSERT((void*)PREV_BLKP(bp) > a->start_of_heap);
         return (PREV_BLKP(bp));
     }
 }
@@ -377,26 +1186,29 @@ void *coalesce(void *bp)
  * requirements of course. Free the former epilogue block
  * and reallocate its new header
  **********************************************************/
-void *extend_heap(size_t words)
+void *extend_heap(arena *a, size_t words)
 {
     char *bp;
     size_t size;
 
     /* Allocate an even number of words to maintain alignments */
     size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-    if ( (bp = mem_sbrk(size)) == (void *)-1 )
+    if ( (bp = arena_sbrk(a, size)) == (void *)-1 )
         return NULL;
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));                // free block header
-    PUT(FTRP(bp), PACK(size, 0));                // free block footer
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));        // new epilogue header
+    /* Initialize free block header/footer and the epilogue header
+     * the old epilogue header becomes the new block's header and
+     * still knows whether the block before it is allocated */
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, prev_alloc));       // free block header
+    PUT(FTRP(bp), PACK(size, prev_alloc));       // free block footer
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC));    // new epilogue header
 
-    epilogue = NEXT_BLKP(bp);
+    a->epilogue = NEXT_BLKP(bp);
     DBG_ASSERT(FTRP(bp) > HDRP(bp));
 
     /* Coalesce if the previous block was free */
-    return coalesce(bp);
+    return coalesce(a, bp);
 }
 
 
@@ -406,10 +1218,10 @@ void *extend_heap(size_t words)
  * Return NULL if no free blocks can handle that size
  * Assumed that asize is aligned
  **********************************************************/
-void * find_fit(size_t asize)
+void * find_fit(arena *a, size_t asize)
 {
     void *bp;
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+    for (bp = a->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
     {
         if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))))
         {
@@ -423,7 +1235,7 @@ void * find_fit(size_t asize)
  * place
  * Mark the block as allocated
  **********************************************************/
-void place(void* bp, size_t asize)
+void place(arena *a, void* bp, size_t asize)
 {
   /* Get the current block size */
   size_t bsize = GET_SIZE(HDRP(bp));
@@ -433,32 +1245,31 @@ void place(void* bp, size_t asize)
   size_t rem_size = bsize - asize;
   if (rem_size < MIN_BLOCK_SIZE) {
       DBG_PRINT("Could not split, required_size:%d, block_size:%d, remaining_size:%d\n", asize, bsize, rem_size);
-      PUT(HDRP(bp), PACK(bsize, 1));
-      PUT(FTRP(bp), PACK(bsize, 1));
-      DBG_ASSERT(FTRP(bp) > HDRP(bp));
+      mark_alloc(bp, bsize);
       return;
   }
   
-  // Can successfully split, allocate block of asize
-  PUT(HDRP(bp), PACK(asize, 1));
-  PUT(FTRP(bp), PACK(asize, 1)); 
-  DBG_PRINT("allocated block at %p, size from header = %d, size from foote = %d\n", bp, GET_SIZE(HDRP(bp)), GET_SIZE(FTRP(bp)));
-  DBG_ASSERT(FTRP(bp) > HDRP(bp));
+  // Can successfully split, allocate block of asize. A realloc
+  // that shrinks a grown block keeps it marked
+  PUT(HDRP(bp), PACK(asize, (GET(HDRP(bp)) & (PREV_ALLOC | REALLOC_HOT)) | ALLOC));
+  DBG_PRINT("allocated block at %p, size from header = %d\n", bp, GET_SIZE(HDRP(bp)));
   
   // Mark next block of size rem_size as empty and add to seg_list
-  PUT(HDRP(NEXT_BLKP(bp)), PACK(rem_size, 0));
-  PUT(FTRP(NEXT_BLKP(bp)), PACK(rem_size, 0));
+  // it may border a free block when a realloc shrinks in place
+  void *rem = NEXT_BLKP(bp);
+  PUT(HDRP(rem), PACK(rem_size, PREV_ALLOC));
+  mark_free(rem, rem_size);
 
-  seg_list_add((list_block*)NEXT_BLKP(bp));
+  seg_list_add(a, (list_block*)coalesce(a, rem));
 }
 
 /**********************************************************
  * print_heap
  * Print the entire known heap.
  **********************************************************/
-void print_heap(){
-    void* it = prologue;
-    for (it = prologue; it != epilogue; it = NEXT_BLKP(it)){
+void print_heap(arena *a){
+    void* it = a->prologue;
+    for (it = a->prologue; it != a->epilogue; it = NEXT_BLKP(it)){
         printf("blk at %p, size=%lu, alloc=%d\n", it, GET_SIZE(HDRP(it)),(int) GET_ALLOC(HDRP(it)));
         if(GET_SIZE(HDRP(it)) == 0){
             printf("manual break point...\n");
@@ -468,39 +1279,295 @@ void print_heap(){
 }
 
 /**********************************************************
- * mm_free
- * Free the block and coalesce with neighbouring blocks
+ * page_release
+ * Release the whole pages between lo and hi
  **********************************************************/
-void mm_free(void *bp)
-{   
-    if(bp == NULL){
-      return;
-    }
-    
-    DBG_ASSERT(bp > start_of_heap);
-    DBG_ASSERT(mm_check());
-    DBG_PRINT("Free request for 0x%p size of %x\n", bp, GET_SIZE(HDRP(bp)));
-    
-    DBG_ASSERT(FTRP(bp) > HDRP(bp));
+void page_release(char *lo, char *hi)
+{
+    uintptr_t page = mem_pagesize();
+    char *start = (char*)(((uintptr_t)lo + page - 1) & ~(page - 1));
+    char *end = (char*)((uintptr_t)hi & ~(page - 1));
+    if (start < end)
+        madvise(start, end - start, RELEASE_ADVICE);
+}
+
+/**********************************************************
+ * block_release
+ * Release the pages of free block bp that hold nothing but
+ * free space, past the links of a list or tree node
+ **********************************************************/
+void block_release(void *bp)
+{
+    page_release((char*)bp + sizeof(tree_block), FTRP(bp));
+}
+
+/**********************************************************
+ * arena_trim
+ * Give back the free block at the top of an arena, except
+ * for pad bytes of it, by moving the epilogue down to the
+ * new top. Returns nonzero if anything was given back
+ **********************************************************/
+int arena_trim(arena *a, size_t pad)
+{
+    if (GET_PREV_ALLOC(HDRP(a->epilogue)))
+        return 0;
+
+    char *last = PREV_BLKP(a->epilogue);
+    size_t size = GET_SIZE(HDRP(last));
+    size_t keep = pad ? MAX(MIN_BLOCK_SIZE, DSIZE * ((pad + DSIZE - 1) / DSIZE)) : 0;
+    if (keep >= size || size - keep < mem_pagesize())
+        return 0;
+
+    // the block before a free block is always allocated
+    seg_list_remove(a, (list_block*)last);
+    char *top = last + keep;
+    PUT(HDRP(top), PACK(0, keep ? ALLOC : (PREV_ALLOC | ALLOC)));   // new epilogue header
+    if (keep) {
+        PUT(HDRP(last), PACK(keep, PREV_ALLOC));
+        PUT(FTRP(last), PACK(keep, PREV_ALLOC));
+        seg_list_add(a, (list_block*)last);
+    }
+
+    page_release(top, a->brk);
+    a->epilogue = top;
+    a->brk = top;
+    return 1;
+}
+
+/**********************************************************
+ * trim_policy
+ * Called with every block that free has just coalesced
+ **********************************************************/
+void trim_policy(arena *a, void *bp)
+{
+#if TRIM_THRESHOLD > 0
+    if (NEXT_BLKP(bp) == a->epilogue && GET_SIZE(HDRP(bp)) >= TRIM_THRESHOLD) {
+        arena_trim(a, TRIM_PAD);
+        return;
+    }
+#endif
+#if RELEASE_THRESHOLD > 0
+    if (GET_SIZE(HDRP(bp)) >= RELEASE_THRESHOLD) {
+        block_release(bp);
+    }
+#endif
+}
+
+/**********************************************************
+ * free_block
+ * Mark the block free, coalesce it and put it on the
+ * segregated lists
+ * Caller must hold heap_lock in thread-safe mode
+ **********************************************************/
+void free_block(arena *a, void *bp)
+{
+    DBG_ASSERT(bp > a->start_of_heap);
+    DBG_ASSERT(arena_check(a));
+    DBG_PRINT("Free request for 0x%p size of %x\n", bp, GET_SIZE(HDRP(bp)));
+    
+    DBG_ASSERT(GET_ALLOC(HDRP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
-    PUT(HDRP(bp), PACK(size,0));
-    PUT(FTRP(bp), PACK(size,0));
+    mark_free(bp, size);
     DBG_ASSERT(FTRP(bp) > HDRP(bp));
 
-    seg_list_add(coalesce(bp));
-    DBG_PRINT_HEAP();
+    bp = coalesce(a, bp);
+    seg_list_add(a, bp);
+    trim_policy(a, bp);
+    DBG_PRINT_HEAP(a);
 }
 
+#ifdef DEFER_COALESCE
+/**********************************************************
+ * quick_consolidate
+ * Free every block on the quick lists of an arena for
+ * real, coalescing them with their neighbours
+ **********************************************************/
+void quick_consolidate(arena *a)
+{
+    int i;
+    for (i = 0; i < QUICK_BINS; i++) {
+        list_block *blk = a->quick[i];
+        a->quick[i] = NULL;
+        while (blk) {
+            list_block *next = blk->next;
+            free_block(a, blk);
+            blk = next;
+        }
+    }
+    a->quick_bytes = 0;
+}
+#endif
 
 /**********************************************************
- * mm_malloc
+ * heap_free
+ * Free the block and coalesce with neighbouring blocks
+ * With -DDEFER_COALESCE small blocks go on a quick list
+ * instead
+ * Caller must hold heap_lock in thread-safe mode
+ **********************************************************/
+void heap_free(arena *a, void *bp)
+{   
+    if(bp == NULL){
+      return;
+    }
+#ifdef DEFER_COALESCE
+    size_t size = GET_SIZE(HDRP(bp));
+    if (size <= QUICK_MAX_SIZE) {
+        list_block **bin = &a->quick[QUICK_INDEX(size)];
+        CLEAR_REALLOC_HOT(bp);
+        ((list_block*)bp)->next = *bin;
+        *bin = (list_block*)bp;
+        if ((a->quick_bytes += size) > QUICK_LIMIT) {
+            quick_consolidate(a);
+        }
+        return;
+    }
+#endif
+    free_block(a, bp);
+}
+
+/**********************************************************
+ * heap_free_run
+ * Free size bytes of allocated blocks that follow each
+ * other from bp on as one block, so they are coalesced
+ * and put on the lists once
+ * Caller must hold heap_lock in thread-safe mode
+ **********************************************************/
+void heap_free_run(arena *a, void *bp, size_t size)
+{
+    DBG_ASSERT(GET_ALLOC(HDRP(bp)));
+    mark_free(bp, size);
+    bp = coalesce(a, bp);
+    seg_list_add(a, bp);
+    trim_policy(a, bp);
+}
+
+
+#if SLAB_MAX_SIZE > 0
+void *heap_memalign(arena *a, size_t align, size_t size);
+
+/**********************************************************
+ * slab_link / slab_unlink
+ * put a run on, or take it off, the list of runs of its
+ * class that have a free slot
+ **********************************************************/
+void slab_link(arena *a, slab_run *run) {
+    slab_run **head = &a->slab_runs[SLAB_CLASS(run->size)];
+    run->prev = NULL;
+    run->next = *head;
+    if (*head) (*head)->prev = run;
+    *head = run;
+}
+
+void slab_unlink(arena *a, slab_run *run) {
+    if (run->prev) run->prev->next = run->next;
+    else a->slab_runs[SLAB_CLASS(run->size)] = run->next;
+    if (run->next) run->next->prev = run->prev;
+}
+
+/**********************************************************
+ * slab_page_set
+ * mark or unmark the page at run as a slab run
+ **********************************************************/
+void slab_page_set(arena *a, slab_run *run, int on) {
+    size_t page = ((char*)run - a->slab_base) / SLAB_RUN_SIZE;
+    if (on) a->slab_pages[page / MAP_BITS] |= 1UL << (page % MAP_BITS);
+    else    a->slab_pages[page / MAP_BITS] &= ~(1UL << (page % MAP_BITS));
+}
+
+/**********************************************************
+ * slab_of
+ * The run that bp was handed out from, or NULL if bp is a
+ * regular block. The page of a live object stays a run, so
+ * this is safe to call without holding the arena's lock
+ **********************************************************/
+slab_run *slab_of(arena *a, void *bp) {
+    size_t page = ((char*)bp - a->slab_base) / SLAB_RUN_SIZE;
+    if (page >= SLAB_PAGES || !((a->slab_pages[page / MAP_BITS] >> (page % MAP_BITS)) & 1))
+        return NULL;
+    return (slab_run*)(a->slab_base + page * SLAB_RUN_SIZE);
+}
+
+/**********************************************************
+ * slab_run_new
+ * Carve a run for slots of size bytes from the top of the
+ * heap. The heap is extended just enough that the payload
+ * of the run block lands on a page boundary, and whatever
+ * lies below it goes back to the free lists
+ **********************************************************/
+slab_run *slab_run_new(arena *a, size_t size) {
+    slab_run *run = heap_memalign(a, SLAB_RUN_SIZE, SLAB_RUN_SIZE);
+    if (run == NULL)
+        return NULL;
+    if ((size_t)((char*)run - a->slab_base) / SLAB_RUN_SIZE >= SLAB_PAGES) {
+        heap_free(a, run);
+        return NULL;
+    }
+
+    int i;
+    run->size = size;
+    run->nslots = (SLAB_RUN_SIZE - SLAB_HDR_SIZE) / size;
+    run->nfree = run->nslots;
+    memset(run->map, 0, sizeof(run->map));
+    for (i = 0; i < run->nslots; i++) {
+        run->map[i / MAP_BITS] |= 1UL << (i % MAP_BITS);
+    }
+    slab_page_set(a, run, 1);
+    slab_link(a, run);
+    return run;
+}
+
+/**********************************************************
+ * slab_alloc
+ * Hand out a free slot for a request of size bytes, a new
+ * run is carved when the class has none left
+ **********************************************************/
+void *slab_alloc(arena *a, size_t size) {
+    slab_run *run = a->slab_runs[SLAB_CLASS(size)];
+    if (run == NULL && (run = slab_run_new(a, DSIZE * (SLAB_CLASS(size) + 1))) == NULL)
+        return NULL;
+
+    int w = 0;
+    while (!run->map[w]) w++;
+    int slot = w * MAP_BITS + __builtin_ctzl(run->map[w]);
+    run->map[w] &= run->map[w] - 1;
+    if (--run->nfree == 0) {
+        slab_unlink(a, run);
+    }
+    return (char*)run + SLAB_HDR_SIZE + slot * run->size;
+}
+
+/**********************************************************
+ * slab_free
+ * Give the slot of bp back to its run. A run that becomes
+ * empty is freed back to the heap, unless it is the only
+ * run of its class with free slots
+ **********************************************************/
+void slab_free(arena *a, slab_run *run, void *bp) {
+    int slot = ((char*)bp - (char*)run - SLAB_HDR_SIZE) / run->size;
+    DBG_ASSERT(!((run->map[slot / MAP_BITS] >> (slot % MAP_BITS)) & 1));
+
+    run->map[slot / MAP_BITS] |= 1UL << (slot % MAP_BITS);
+    if (run->nfree++ == 0) {
+        slab_link(a, run);
+    } else if (run->nfree == run->nslots && (run->prev || run->next)) {
+        slab_unlink(a, run);
+        slab_page_set(a, run, 0);
+        heap_free(a, run);
+    }
+}
+#endif
+
+/**********************************************************
+ * heap_malloc
  * Allocate a block of size bytes.
  * The type of search is determined by find_fit
  * The decision of splitting the block, or not is determined
  *   in place(..)
  * If no block satisfies the request, the heap is extended
+ * Caller must hold heap_lock in thread-safe mode
  **********************************************************/
-void *mm_malloc(size_t size)
+void *heap_malloc(arena *a, size_t size)
 {
     size_t asize; /* adjusted block size */
     size_t extendsize; /* amount to extend heap if no fit */
@@ -511,44 +1578,717 @@ void *mm_malloc(size_t size)
     if (size == 0)
         return NULL;
 
+#if SLAB_MAX_SIZE > 0
+    if (size <= SLAB_MAX_SIZE && (bp = slab_alloc(a, size)) != NULL)
+        return bp;
+#endif
 
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1))/ DSIZE);
+    asize = ADJUST_SIZE(size);
  
     DBG_PRINT("Malloc request size: %lu\n", asize);
+#ifdef DEFER_COALESCE
+    /* A block of exactly this size may be waiting on a quick list */
+    if (asize <= QUICK_MAX_SIZE && a->quick[QUICK_INDEX(asize)]) {
+        list_block *blk = a->quick[QUICK_INDEX(asize)];
+        a->quick[QUICK_INDEX(asize)] = blk->next;
+        a->quick_bytes -= asize;
+        return blk;
+    }
+#endif
     /* Search the free list for a fit */
-    if ((bp = seg_list_find_fit(asize)) != NULL) {
-        place(bp, asize);
-        DBG_ASSERT((void*)bp > start_of_heap);
+    if ((bp = seg_list_find_fit(a, asize)) != NULL) {
+        place(a, bp, asize);
+        DBG_ASSERT((void*)bp > a->start_of_heap);
         return bp;
     }
+#ifdef DEFER_COALESCE
+    /* Coalesce what the quick lists hold and look again */
+    if (a->quick_bytes) {
+        quick_consolidate(a);
+        if ((bp = seg_list_find_fit(a, asize)) != NULL) {
+            place(a, bp, asize);
+            return bp;
+        }
+    }
+#endif
 
     /* No fit found. Get more memory and place the block */
     extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+    if ((bp = extend_heap(a, extendsize/WSIZE)) == NULL)
         return NULL;
-    place(bp, asize);
-    DBG_ASSERT((void*)bp > start_of_heap);
+    place(a, bp, asize);
+    DBG_ASSERT((void*)bp > a->start_of_heap);
     return bp;
 
 }
 
 /**********************************************************
- * mm_realloc
- * Implemented simply in terms of mm_malloc and mm_free
+ * heap_memalign
+ * Allocate a block of size bytes whose payload is aligned
+ * to align, a power of two above DSIZE.
+ * A free block with room for the worst leading gap is
+ * taken from the lists, or the heap is extended. The gap
+ * before the aligned payload becomes a free block of its
+ * own, and place splits off the rest after it, so both
+ * fragments go back to the free lists
+ * Caller must hold heap_lock in thread-safe mode
+ **********************************************************/
+void *heap_memalign(arena *a, size_t align, size_t size)
+{
+    size_t asize, need;
+    char *bp;
+
+    if (size == 0 || size > (size_t)-1 / 4 || align > (size_t)-1 / 4)
+        return NULL;
+
+    asize = ADJUST_SIZE(size);
+    // a gap before the payload is either empty or a whole free block
+    need = asize + align + MIN_BLOCK_SIZE;
+
+    if ((bp = seg_list_find_fit(a, need)) == NULL) {
+#ifdef DEFER_COALESCE
+        if (a->quick_bytes) {
+            quick_consolidate(a);
+            bp = seg_list_find_fit(a, need);
+        }
+        if (bp == NULL)
+#endif
+        {
+            // the new block starts at the epilogue, or lower when it
+            // merges with a free block there
+            size_t pad = -(uintptr_t)a->epilogue & (align - 1);
+            if (pad != 0 && pad < MIN_BLOCK_SIZE)
+                pad += align;
+            if ((bp = extend_heap(a, MAX(pad + asize, CHUNKSIZE) / WSIZE)) == NULL)
+                return NULL;
+        }
+    }
+
+    size_t bsize = GET_SIZE(HDRP(bp));
+    char *p = (char*)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+    if (p != bp && p - bp < MIN_BLOCK_SIZE)
+        p += align;
+    size_t gap = p - bp;
+    DBG_ASSERT(gap + asize <= bsize);
+
+    if (gap) {
+        // the block below bp may be free when bp was split off its top
+        uintptr_t word = PACK(gap, GET_PREV_ALLOC(HDRP(bp)));
+        PUT(HDRP(p), PACK(bsize - gap, ALLOC));
+        PUT(HDRP(bp), word);
+        PUT(FTRP(bp), word);
+        seg_list_add(a, (list_block*)coalesce(a, bp));
+    }
+    place(a, p, asize);
+    return p;
+}
+
+/**********************************************************
+ * heap_malloc_batch
+ * Allocate n blocks of size bytes into out, returns how
+ * many were allocated.
+ * Tiny requests come from the slabs. Otherwise all n are
+ * carved one after the other from a single free block, or
+ * a single extension of the heap, and place splits off the
+ * rest of it. What can't be had that way is allocated one
+ * block at a time
+ * Caller must hold heap_lock in thread-safe mode
+ **********************************************************/
+int heap_malloc_batch(arena *a, size_t size, int n, void **out)
+{
+    int i = 0;
+    char *bp;
+
+    if (size == 0 || n <= 0)
+        return 0;
+#if SLAB_MAX_SIZE > 0
+    if (size <= SLAB_MAX_SIZE) {
+        while (i < n && (out[i] = slab_alloc(a, size)) != NULL)
+            i++;
+    }
+#endif
+
+    size_t asize = ADJUST_SIZE(size);
+    if (i < n && (size_t)(n - i) <= ((size_t)-1 / 4) / asize) {
+        size_t total = asize * (n - i);
+        if ((bp = seg_list_find_fit(a, total)) == NULL)
+            bp = extend_heap(a, MAX(total, CHUNKSIZE) / WSIZE);
+        if (bp != NULL) {
+            size_t left = GET_SIZE(HDRP(bp));
+            uintptr_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+            for (; i < n - 1; i++) {
+                PUT(HDRP(bp), PACK(asize, prev_alloc | ALLOC));
+                out[i] = bp;
+                bp += asize;
+                left -= asize;
+                prev_alloc = PREV_ALLOC;
+            }
+            PUT(HDRP(bp), PACK(left, prev_alloc | ALLOC));
+            place(a, bp, asize);
+            out[i++] = bp;
+        }
+    }
+
+    while (i < n && (out[i] = heap_malloc(a, size)) != NULL)
+        i++;
+    return i;
+}
+
+/**********************************************************
+ * heap_realloc
+ * Resize in place when the block itself, the free block
+ * after it or the top of the heap (grown in place) leave
+ * room. Otherwise slide down into a free block before it
+ * with memmove, and only when even that is too small fall
+ * back to heap_malloc, copy and heap_free
+ * Growing in place takes exactly what is needed and frees
+ * the rest. A grown block is marked REALLOC_HOT, and when a
+ * hot block has to move it gets geometric slack, so a block
+ * that keeps growing moves less often. The mark survives a
+ * shrink unless the new size is one the thread caches take
+ * (see REALLOC_HOT_MIN), and is dropped once the block is
+ * freed
+ * Caller must hold heap_lock in thread-safe mode
  *********************************************************/
-void *mm_realloc(void *ptr, size_t size)
+void *heap_realloc(arena *a, void *ptr, size_t size)
 {   
-    int orig_sz = GET_SIZE(HDRP(ptr));
-    DBG_ASSERT(GET(HDRP(ptr)) == GET(FTRP(ptr)));
+    a->stats.realloc_calls++;
+#if SLAB_MAX_SIZE > 0
+    // a slot can't grow, move it when it is too small
+    slab_run *run = slab_of(a, ptr);
+    if (run) {
+        if (size <= run->size) {
+            a->stats.realloc_in_place++;
+            return ptr;
+        }
+        void *newptr = heap_malloc(a, size);
+        if (newptr == NULL)
+            return NULL;
+        memcpy(newptr, ptr, run->size);
+        slab_free(a, run, ptr);
+        a->stats.realloc_copied++;
+        a->stats.bytes_moved += run->size;
+        return newptr;
+    }
+#endif
+    size_t orig_sz = GET_SIZE(HDRP(ptr));
+    DBG_ASSERT(GET_ALLOC(HDRP(ptr)));
+
+
+    DBG_PRINT_HEAP(a);
+
+    DBG_PRINT("realloc request for 0x%p orig_sz: %lx, request_size: %lx\n", ptr, orig_sz, size);
+
+    /* Adjust block size to include overhead and alignment reqs. */
+    size_t asize = ADJUST_SIZE(size);
+
+
+    DBG_PRINT("heap epilogue now at:%p\n", a->epilogue);
+    if (asize <= orig_sz){
+        // shrink, splitting off the tail if it makes a block
+        if (orig_sz - asize >= MIN_BLOCK_SIZE)
+            place(a, ptr, asize);
+        if (asize <= REALLOC_HOT_MIN)
+            CLEAR_REALLOC_HOT(ptr);
+        a->stats.realloc_in_place++;
+        return ptr;
+    }
+
+    // room to grow into for blocks that were grown before
+    size_t want = asize;
+    if (GET(HDRP(ptr)) & REALLOC_HOT)
+        want += DSIZE * (MIN(asize >> REALLOC_SLACK_SHIFT, REALLOC_SLACK_MAX) / DSIZE);
+
+    // what the free neighbours of ptr add up to
+    char *next = NEXT_BLKP(ptr);
+    size_t next_sz = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+    char *prev = GET_PREV_ALLOC(HDRP(ptr)) ? NULL : PREV_BLKP(ptr);
+    size_t prev_sz = prev ? GET_SIZE(HDRP(prev)) : 0;
+    // ptr ends the heap, or only a free block lies between them
+    int at_top = (next_sz ? NEXT_BLKP(next) : next) == (char*)a->epilogue;
+    size_t new_sz;
+    void *bp;
+
+    if (orig_sz + next_sz >= asize) {
+        // grow into the next block
+        seg_list_remove(a, (list_block*)next);
+        new_sz = orig_sz + next_sz;
+    } else if (at_top &&
+               (bp = extend_heap(a, (asize - orig_sz - next_sz) / WSIZE))) {
+        // grow the heap under the block, the new space merges with
+        // the free block after ptr if there is one. If the heap is out
+        // of room the block can still slide down or be copied
+        new_sz = orig_sz + GET_SIZE(HDRP(bp));
+    } else if (prev_sz + orig_sz + next_sz >= asize) {
+        // slide down into the previous block, the payload may overlap
+        seg_list_remove(a, (list_block*)prev);
+        if (next_sz)
+            seg_list_remove(a, (list_block*)next);
+        memmove(prev, ptr, orig_sz - WSIZE);
+        a->stats.realloc_moved++;
+        a->stats.bytes_moved += orig_sz - WSIZE;
+        ptr = prev;
+        new_sz = prev_sz + orig_sz + next_sz;
+    } else {
+        DBG_PRINT("CONTIGUOUS ALLOCATION FAILED!!\n");
+        // failed to find contigous memory block, allocate new block using malloc
+        void* newptr = heap_malloc(a, want - WSIZE);
+        if (newptr == NULL)
+            return NULL;
+        if (asize > REALLOC_HOT_MIN
+#if SLAB_MAX_SIZE > 0
+            && !slab_of(a, newptr)
+#endif
+            )
+            PUT(HDRP(newptr), GET(HDRP(newptr)) | REALLOC_HOT);
+        // the payload is everything but the header
+        memcpy(newptr, ptr, orig_sz - WSIZE);
+        a->stats.realloc_copied++;
+        a->stats.bytes_moved += orig_sz - WSIZE;
+
+        heap_free(a, ptr);
+        DBG_PRINT_HEAP(a);
+        return newptr;
+    }
+
+    // hand back whatever the merged span has beyond asize, otherwise
+    // a block that keeps growing swallows every free block after it
+    DBG_ASSERT(new_sz >= asize);
+    mark_alloc(ptr, new_sz);
+    place(a, ptr, ptr == prev ? MIN(want, new_sz) : asize);
+    if (asize > REALLOC_HOT_MIN)
+        PUT(HDRP(ptr), GET(HDRP(ptr)) | REALLOC_HOT);
+    if (ptr != prev)
+        a->stats.realloc_in_place++;
+    DBG_PRINT("allocated block at %p, size from header = %lx\n", ptr, GET_SIZE(HDRP(ptr)));
+    DBG_PRINT_HEAP(a);
+    return ptr;
+}
+
+/**********************************************************
+ * payload_size
+ * The number of bytes the caller may use at bp, a block
+ * or slab slot of arena a
+ **********************************************************/
+size_t payload_size(arena *a, void *bp)
+{
+#if SLAB_MAX_SIZE > 0
+    slab_run *run = slab_of(a, bp);
+    if (run)
+        return run->size;
+#endif
+    return GET_SIZE(HDRP(bp)) - WSIZE;
+}
+
+#if MMAP_THRESHOLD > 0
+/**********************************************************
+ * mmap_alloc
+ * Give a request of size bytes a mapping of its own
+ **********************************************************/
+void *mmap_alloc(size_t size)
+{
+    size_t len = (size + DSIZE + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    char *base = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    PUT(base + WSIZE, PACK(len, MAPPED | ALLOC));
+    return base + DSIZE;
+}
+
+/**********************************************************
+ * mmap_free
+ * Unmap a mapped block
+ **********************************************************/
+void mmap_free(void *bp)
+{
+    DBG_ASSERT(GET(HDRP(bp)) & MAPPED);
+    munmap((char*)bp - DSIZE, GET_SIZE(HDRP(bp)));
+}
+
+/**********************************************************
+ * mmap_realloc
+ * Resize a mapped block with mremap, which moves pages
+ * rather than copying them
+ **********************************************************/
+void *mmap_realloc(void *bp, size_t size)
+{
+    DBG_ASSERT(GET(HDRP(bp)) & MAPPED);
+    size_t len = (size + DSIZE + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    if (len == GET_SIZE(HDRP(bp)))
+        return bp;
+    char *base = mremap((char*)bp - DSIZE, GET_SIZE(HDRP(bp)), len, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED)
+        return NULL;
+    PUT(base + WSIZE, PACK(len, MAPPED | ALLOC));
+    return base + DSIZE;
+}
+#endif
+
+#ifdef THREAD_SAFE
+/**********************************************************
+ * tcache_flush
+ * Hand up to n blocks of a bin back to the arenas that own
+ * them. An arena's lock is only switched when consecutive
+ * blocks belong to different arenas
+ **********************************************************/
+void tcache_flush(tcache_bin *bin, int n)
+{
+    arena *a = NULL;
+    while (n-- > 0 && bin->head) {
+        list_block *blk = bin->head;
+        bin->head = blk->next;
+        bin->count--;
+        if (arena_of(blk) != a) {
+            if (a) ARENA_UNLOCK(a);
+            a = arena_of(blk);
+            ARENA_LOCK(a);
+        }
+#if SLAB_MAX_SIZE > 0
+        slab_run *run = slab_of(a, blk);
+        if (run) {
+            slab_free(a, run, blk);
+            continue;
+        }
+#endif
+        heap_free(a, blk);
+    }
+    if (a) ARENA_UNLOCK(a);
+}
+
+/**********************************************************
+ * tcache_destroy
+ * Thread exit destructor, returns every cached block
+ **********************************************************/
+void tcache_destroy(void *arg)
+{
+    tcache *tc = (tcache*)arg;
+    int i;
+    if (tc->gen != heap_gen) return;
+    for (i = 0; i < TCACHE_ALL_BINS; i++) {
+        tcache_flush(&tc->bins[i], tc->bins[i].count);
+    }
+}
+
+void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/**********************************************************
+ * tcache_get
+ * Return the calling thread's cache, dropping whatever it
+ * held if the heap was re-initialized since
+ **********************************************************/
+tcache *tcache_get(void)
+{
+    tcache *tc = &thread_cache;
+    if (tc->gen != heap_gen) {
+        memset(tc->bins, 0, sizeof(tc->bins));
+        tc->gen = heap_gen;
+    }
+    if (!tc->registered) {
+        pthread_once(&tcache_key_once, tcache_key_init);
+        pthread_setspecific(tcache_key, tc);
+        tc->registered = 1;
+    }
+    return tc;
+}
+
+/**********************************************************
+ * tcache_put
+ * Cache a freed block in bin, making room first if the
+ * bin is full
+ **********************************************************/
+void tcache_put(tcache_bin *bin, void *bp)
+{
+    if (bin->count == TCACHE_COUNT) {
+        tcache_flush(bin, TCACHE_BATCH);
+    }
+    ((list_block*)bp)->next = bin->head;
+    bin->head = (list_block*)bp;
+    bin->count++;
+}
+#endif
+
+/**********************************************************
+ * mm_free
+ * Free the block back to the arena that owns it
+ * Tiny objects go back to their slab run. In thread-safe
+ * mode small blocks are kept in the thread's cache instead
+ **********************************************************/
+void mm_free(void *bp)
+{
+    if(bp == NULL){
+      return;
+    }
+    arena *a = arena_of(bp);
+#if MMAP_THRESHOLD > 0
+    if (a == NULL) {
+        mmap_free(bp);
+        return;
+    }
+#endif
+#if SLAB_MAX_SIZE > 0
+    slab_run *run = slab_of(a, bp);
+    if (run) {
+#ifdef THREAD_SAFE
+        tcache_put(&tcache_get()->bins[TCACHE_SLAB_INDEX(run->size)], bp);
+#else
+        slab_free(a, run, bp);
+#endif
+        return;
+    }
+#endif
+#ifdef THREAD_SAFE
+    size_t size = GET_SIZE(HDRP(bp));
+    if (size <= TCACHE_MAX_SIZE) {
+        DBG_ASSERT(!(GET(HDRP(bp)) & REALLOC_HOT));
+        tcache_put(&tcache_get()->bins[TCACHE_INDEX(size)], bp);
+        return;
+    }
+#endif
+    ARENA_LOCK(a);
+    heap_free(a, bp);
+    ARENA_UNLOCK(a);
+}
+
+/**********************************************************
+ * mm_free_sized
+ * Free a block of size bytes, the size given to mm_malloc
+ * or to the last mm_realloc of it. In thread-safe mode a
+ * small block is cached by that size without reading or
+ * writing its header, it never carries REALLOC_HOT (see
+ * REALLOC_HOT_MIN); a block that is larger than its size
+ * says only sits in a smaller bin until the bin is flushed.
+ * Without THREAD_SAFE there is no cache and the size is
+ * only a hint, the block is freed like mm_free does. The
+ * header is only read, to check the size, with -DDBG
+ **********************************************************/
+void mm_free_sized(void *bp, size_t size)
+{
+    if(bp == NULL){
+      return;
+    }
+#ifdef THREAD_SAFE
+    arena *a = arena_of(bp);
+#if MMAP_THRESHOLD > 0
+    if (a == NULL) {
+        mmap_free(bp);
+        return;
+    }
+#endif
+    DBG_ASSERT(size > 0 && size <= payload_size(a, bp));
+#if SLAB_MAX_SIZE > 0
+    if (size <= SLAB_MAX_SIZE && slab_of(a, bp)) {
+        tcache_put(&tcache_get()->bins[TCACHE_SLAB_INDEX(size)], bp);
+        return;
+    }
+#endif
+    size_t asize = ADJUST_SIZE(size);
+    if (asize <= TCACHE_MAX_SIZE) {
+        DBG_ASSERT(!(GET(HDRP(bp)) & REALLOC_HOT));
+        tcache_put(&tcache_get()->bins[TCACHE_INDEX(asize)], bp);
+        return;
+    }
+    ARENA_LOCK(a);
+    heap_free(a, bp);
+    ARENA_UNLOCK(a);
+#else
+    DBG_ASSERT(arena_of(bp) == NULL || (size > 0 && size <= payload_size(arena_of(bp), bp)));
+    mm_free(bp);
+#endif
+}
+
+
+/**********************************************************
+ * mm_malloc
+ * Allocate a block of size bytes from the thread's arena
+ * In thread-safe mode the thread's cache is tried first
+ **********************************************************/
+void *mm_malloc(size_t size)
+{
+    void *bp;
+#if MMAP_THRESHOLD > 0
+    if (size >= MMAP_THRESHOLD)
+        return mmap_alloc(size);
+#endif
+#ifdef THREAD_SAFE
+    if (size == 0)
+        return NULL;
+    size_t asize = ADJUST_SIZE(size); /* adjusted block size */
+    tcache_bin *bin = NULL;
+#if SLAB_MAX_SIZE > 0
+    if (size <= SLAB_MAX_SIZE)
+        bin = &tcache_get()->bins[TCACHE_SLAB_INDEX(size)];
+    else
+#endif
+    if (asize <= TCACHE_MAX_SIZE)
+        bin = &tcache_get()->bins[TCACHE_INDEX(asize)];
+
+    if (bin) {
+        if (bin->head) {
+            bp = bin->head;
+            bin->head = bin->head->next;
+            bin->count--;
+            return bp;
+        }
+    }
+#endif
+    arena *a = arena_get();
+    ARENA_LOCK(a);
+    bp = heap_malloc(a, size);
+    ARENA_UNLOCK(a);
+    // an mmap arena that ran out of room falls back to the main heap
+    if (bp == NULL && a != &main_arena && size != 0) {
+        ARENA_LOCK(&main_arena);
+        bp = heap_malloc(&main_arena, size);
+        ARENA_UNLOCK(&main_arena);
+    }
+    return bp;
+}
 
+/**********************************************************
+ * mm_memalign
+ * Allocate a block of size bytes aligned to align, a power
+ * of two. Aligned blocks always come from the arenas, a
+ * mapped block is only DSIZE aligned
+ **********************************************************/
+void *mm_memalign(size_t align, size_t size)
+{
+    void *bp;
+    if (align == 0 || (align & (align - 1)))
+        return NULL;
+    if (align <= DSIZE)
+        return mm_malloc(size);
+
+    arena *a = arena_get();
+    ARENA_LOCK(a);
+    bp = heap_memalign(a, align, size);
+    ARENA_UNLOCK(a);
+    if (bp == NULL && a != &main_arena) {
+        ARENA_LOCK(&main_arena);
+        bp = heap_memalign(&main_arena, align, size);
+        ARENA_UNLOCK(&main_arena);
+    }
+    return bp;
+}
 
-    DBG_PRINT_HEAP();
+/**********************************************************
+ * mm_malloc_batch
+ * Allocate n blocks of size bytes into out, with a single
+ * trip to the thread's arena. Returns how many blocks were
+ * allocated, fewer than n when memory ran out
+ **********************************************************/
+int mm_malloc_batch(size_t size, int n, void **out)
+{
+    int i = 0;
+#if MMAP_THRESHOLD > 0
+    if (size >= MMAP_THRESHOLD) {
+        while (i < n && (out[i] = mmap_alloc(size)) != NULL)
+            i++;
+        return i;
+    }
+#endif
+#ifdef THREAD_SAFE
+    if (size == 0)
+        return 0;
+    // drain the thread's cache first
+    size_t asize = ADJUST_SIZE(size);
+    tcache_bin *bin = NULL;
+#if SLAB_MAX_SIZE > 0
+    if (size <= SLAB_MAX_SIZE)
+        bin = &tcache_get()->bins[TCACHE_SLAB_INDEX(size)];
+    else
+#endif
+    if (asize <= TCACHE_MAX_SIZE)
+        bin = &tcache_get()->bins[TCACHE_INDEX(asize)];
+    while (bin && i < n && bin->head) {
+        out[i++] = bin->head;
+        bin->head = bin->head->next;
+        bin->count--;
+    }
+#endif
+    arena *a = arena_get();
+    if (i < n) {
+        ARENA_LOCK(a);
+        i += heap_malloc_batch(a, size, n - i, out + i);
+        ARENA_UNLOCK(a);
+    }
+    if (i < n && a != &main_arena) {
+        ARENA_LOCK(&main_arena);
+        i += heap_malloc_batch(&main_arena, size, n - i, out + i);
+        ARENA_UNLOCK(&main_arena);
+    }
+    return i;
+}
+
+int ptr_cmp(const void *x, const void *y)
+{
+    uintptr_t p = (uintptr_t)*(void * const *)x, q = (uintptr_t)*(void * const *)y;
+    return (p > q) - (p < q);
+}
 
-    DBG_PRINT("realloc request for 0x%p orig_sz: %x, request_size: %x\n", ptr, orig_sz, size);
+/**********************************************************
+ * mm_free_batch
+ * Free n blocks at once. ptrs is sorted by address in
+ * place, so the caller's array comes back reordered; the
+ * blocks of an arena come together and its lock is taken
+ * once, and a run of blocks that follow each other in the
+ * heap is freed as one block
+ **********************************************************/
+void mm_free_batch(void **ptrs, int n)
+{
+    arena *a = NULL;
+    int i, j;
+
+    if (n <= 0)
+        return;
+    qsort(ptrs, n, sizeof(void*), ptr_cmp);
+    for (i = 0; i < n; i = j) {
+        void *bp = ptrs[i];
+        j = i + 1;
+        if (bp == NULL)
+            continue;
+        arena *owner = arena_of(bp);
+#if MMAP_THRESHOLD > 0
+        if (owner == NULL) {
+            mmap_free(bp);
+            continue;
+        }
+#endif
+        if (owner != a) {
+            if (a) ARENA_UNLOCK(a);
+            a = owner;
+            ARENA_LOCK(a);
+        }
+#if SLAB_MAX_SIZE > 0
+        slab_run *run = slab_of(a, bp);
+        if (run) {
+            slab_free(a, run, bp);
+            continue;
+        }
+#endif
+        size_t size = GET_SIZE(HDRP(bp));
+        while (j < n && ptrs[j] == (char*)bp + size) {
+            DBG_ASSERT(GET_ALLOC(HDRP(ptrs[j])));
+            size += GET_SIZE(HDRP(ptrs[j]));
+            j++;
+        }
+        heap_free_run(a, bp, size);
+    }
+    if (a) ARENA_UNLOCK(a);
+}
+
+/**********************************************************
+ * mm_realloc
+ * Implemented in terms of heap_realloc, which grows into
+ * the next block if it can. The block stays in the arena
+ * that owns it
+ *********************************************************/
+void *mm_realloc(void *ptr, size_t size)
+{
     /* If size == 0 then this is just free, and we return NULL. */
     if(size == 0){
       mm_free(ptr);
@@ -558,116 +2298,244 @@ void *mm_realloc(void *ptr, size_t size)
     if (ptr == NULL)
       return (mm_malloc(size));
 
-    DBG_ASSERT(FTRP(ptr) > HDRP(ptr));
-
-    size_t asize; /* adjusted block size */
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1))/ DSIZE);
-
+    arena *a = arena_of(ptr);
+    void *newptr;
+#if MMAP_THRESHOLD > 0
+    if (a == NULL) {
+        if (size >= MMAP_THRESHOLD)
+            return mmap_realloc(ptr, size);
+        // small enough for the heap again
+        if ((newptr = mm_malloc(size)) == NULL)
+            return NULL;
+        memcpy(newptr, ptr, size);
+        mmap_free(ptr);
+        return newptr;
+    }
+    if (size >= MMAP_THRESHOLD) {
+        // move a block that grew past the threshold to a mapping
+        size_t old_size = payload_size(a, ptr);
+        if ((newptr = mmap_alloc(size)) == NULL)
+            return NULL;
+        memcpy(newptr, ptr, MIN(old_size, size));
+        mm_free(ptr);
+        return newptr;
+    }
+#endif
+    ARENA_LOCK(a);
+    newptr = heap_realloc(a, ptr, size);
+    ARENA_UNLOCK(a);
+    // a block that can't grow in a full mmap arena moves to the main heap
+    if (newptr == NULL && a != &main_arena && (newptr = mm_malloc(size)) != NULL) {
+        memcpy(newptr, ptr, MIN(payload_size(a, ptr), size));
+        mm_free(ptr);
+    }
+    return newptr;
+}
 
-    DBG_PRINT("heap epilogue now at:%p\n", epilogue);
-    if (asize == orig_sz){
-        DBG_ASSERT(FTRP(ptr) > HDRP(ptr));
-        return ptr;
-    }else if (asize < orig_sz){
-        int rem_size = orig_sz - asize;
-        if(rem_size < (2 * DSIZE)){
-            //couldn't split
-            return ptr;
-        }
-        // Can successfully split, allocate block of asize
-        place(ptr,asize);
-        return ptr;
-    }else{ // size > ptr
- 	DBG_ASSERT(GET(HDRP(ptr)) == GET(FTRP(ptr)));
-        int i_size;
-        int i = 0;
-        void *iptr = ptr;
-        // loop will never go beyond 2 iterations
-        for (i_size = 0; i_size < asize; iptr = NEXT_BLKP(iptr)) {
-            if ((GET_ALLOC(HDRP(iptr)) && i != 0) || iptr > epilogue)   {
-                DBG_PRINT("CONTIGUOUS ALLOCATION FAILED!!\n");
-                // failed to find contigous memory block, allocate new block using malloc
-                void* newptr = mm_malloc(asize);
-                memcpy(newptr, ptr, orig_sz);
-
-                DBG_ASSERT(FTRP(ptr) > HDRP(ptr));
-                mm_free(ptr);
-                DBG_ASSERT(FTRP(newptr) > HDRP(newptr));
-                DBG_PRINT_HEAP();
-                return newptr;
-            }
-        DBG_ASSERT(FTRP(iptr) > HDRP(iptr));
-        DBG_PRINT("%dth block @ %p, size: %x\n", i, iptr, GET_SIZE(HDRP(iptr)));
-	    DBG_ASSERT(GET(HDRP(iptr)) == GET(FTRP(iptr)));
-            i_size += GET_SIZE(HDRP(iptr));
-            i++;
-        }
-        // success, mark all i blocks as allocated, remove from free lists, return same ptr
-        DBG_PRINT("CONTIGUOUS BlOCKS SUCCESS! original block at:%p, i_size:%x, asize:%x, orig_sz:%x, num_blocks:%d\n", ptr, i_size, asize, orig_sz, i-1);
-        int ii;
+/**********************************************************
+ * mm_usable_size
+ * The number of bytes the caller may use at ptr, at least
+ * as many as it asked for
+ *********************************************************/
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    arena *a = arena_of(ptr);
+#if MMAP_THRESHOLD > 0
+    if (a == NULL)
+        return GET_SIZE(HDRP(ptr)) - DSIZE;
+#endif
+    return payload_size(a, ptr);
+}
 
-        //loop won't go beyond 1 iteration
-        for (iptr = NEXT_BLKP(ptr), ii=1; ii < i; ii++, iptr = NEXT_BLKP(iptr)){
-            DBG_PRINT("removing %dth block @ 0x%p, size: %x\n", ii, iptr, GET_SIZE(HDRP(iptr)));
-            seg_list_remove((list_block*)iptr);
+/**********************************************************
+ * mm_trim
+ * Give the free space at the top of every arena back,
+ * keeping pad bytes at each top, and release the pages of
+ * every free block. Returns nonzero if any arena shrank
+ **********************************************************/
+int mm_trim(size_t pad)
+{
+    int i, j, trimmed = 0;
+    for (i = 0; i < NUM_ARENAS; i++) {
+#if NUM_ARENAS > 1
+        arena *a = arenas[i];
+        if (a == NULL) continue;
+#else
+        arena *a = &main_arena;
+#endif
+        ARENA_LOCK(a);
+#ifdef DEFER_COALESCE
+        quick_consolidate(a);
+#endif
+        trimmed |= arena_trim(a, pad);
+        for (j = 0; j < NUM_LISTS; j++) {
+            list_block *ls = a->seg_lists[j];
+            if (!ls) continue;
+            do {
+                block_release(ls);
+                ls = ls->next;
+            } while (ls != a->seg_lists[j]);
         }
+#if LARGE_TREE
+        tree_release(a->tree);
+#endif
+        ARENA_UNLOCK(a);
+    }
+    return trimmed;
+}
 
-        //can add remainder to seg list but don't to optimize for realloc heavy lab
-        DBG_ASSERT(i_size >= asize);
-        PUT(HDRP(ptr), PACK(i_size, 1));
-        PUT(FTRP(ptr), PACK(i_size, 1));
-        DBG_ASSERT(FTRP(ptr) > HDRP(ptr));
-    	DBG_PRINT("allocated block at %p, size from header = %x, size from footer = %x\n", ptr, GET_SIZE(HDRP(ptr)), GET_SIZE(FTRP(ptr)));
-        DBG_PRINT_HEAP();
-        return ptr;
+/**********************************************************
+ * mm_get_stats
+ * Sum the realloc and lock counters of every arena into stats
+ **********************************************************/
+void mm_get_stats(mm_stats_t *stats)
+{
+    int i;
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < NUM_ARENAS; i++) {
+#if NUM_ARENAS > 1
+        arena *a = arenas[i];
+        if (a == NULL) continue;
+#else
+        arena *a = &main_arena;
+#endif
+        ARENA_LOCK(a);
+        stats->realloc_calls += a->stats.realloc_calls;
+        stats->realloc_in_place += a->stats.realloc_in_place;
+        stats->realloc_moved += a->stats.realloc_moved;
+        stats->realloc_copied += a->stats.realloc_copied;
+        stats->bytes_moved += a->stats.bytes_moved;
+        stats->lock_acquired += a->stats.lock_acquired;
+        stats->lock_contended += a->stats.lock_contended;
+        ARENA_UNLOCK(a);
     }
+}
+
+#ifdef THREAD_SAFE
+/**********************************************************
+ * mm_fork_prepare, mm_fork_parent, mm_fork_child
+ * pthread_atfork handlers. prepare takes every lock of the
+ * allocator so that no other thread is in the middle of
+ * changing a heap when fork copies it, parent and child
+ * release them again. No path holds two of these locks at
+ * once, so taking them in any one order cannot deadlock
+ **********************************************************/
+void mm_fork_prepare(void)
+{
+#if NUM_ARENAS > 1
+    int i;
+    // held throughout, so no arena is created in between
+    pthread_mutex_lock(&arenas_lock);
+    for (i = 0; i < NUM_ARENAS; i++)
+        if (arenas[i])
+            pthread_mutex_lock(&arenas[i]->lock);
+#else
+    pthread_mutex_lock(&main_arena.lock);
+#endif
+}
+
+void mm_fork_parent(void)
+{
+#if NUM_ARENAS > 1
+    int i;
+    for (i = NUM_ARENAS - 1; i >= 0; i--)
+        if (arenas[i])
+            pthread_mutex_unlock(&arenas[i]->lock);
+    pthread_mutex_unlock(&arenas_lock);
+#else
+    pthread_mutex_unlock(&main_arena.lock);
+#endif
+}
 
+// the child has only the thread that forked, which is the one that
+// took the locks in prepare, so it can release them like the parent
+void mm_fork_child(void)
+{
+    mm_fork_parent();
 }
+#endif
 
 /**********************************************************
  * count_in_free_list
  * Count the number of times a free block occurs in
  * the free lists. 
  *********************************************************/
-int count_in_free_list(void* p){
+int count_in_free_list(arena *a, void* p){
     int i, count=0;
     for (i = 0; i < NUM_LISTS; i++) {
-        list_block *ls = seg_lists[i];
+        list_block *ls = a->seg_lists[i];
         if (!ls) continue;
         do {
             if (p==ls){
                 count++;
             }
             ls = ls->next;
-        } while (ls != seg_lists[i]); 
+        } while (ls != a->seg_lists[i]); 
+    }
+#if LARGE_TREE
+    // a block of the last class is looked up in the tree by its key
+    if (!GET_ALLOC(HDRP(p)) && calc_size_class(GET_SIZE(HDRP(p))) == TREE_CLASS) {
+        tree_block *t = a->tree;
+        while (t && t != p) {
+            t = tree_less((tree_block*)p, t) ? t->left : t->right;
+        }
+        count += t != NULL;
     }
+#endif
     return count;
 }
 
+#if LARGE_TREE
 /**********************************************************
- * mm_check
- * Check the consistency of the memory heap
+ * tree_check
+ * Whether every node under t is a free block of the last
+ * class, in order between lo and hi (either may be NULL),
+ * and a child of its parent with no higher priority
+ *********************************************************/
+int tree_check(tree_block *t, tree_block *lo, tree_block *hi){
+    if (!t){
+        return 1;
+    }
+    if (GET_ALLOC(HDRP(t)) || calc_size_class(GET_SIZE(HDRP(t))) != TREE_CLASS){
+        return 0;
+    }
+    if ((lo && !tree_less(lo, t)) || (hi && !tree_less(t, hi))){
+        return 0;
+    }
+    if ((t->left && (t->left->parent != t || tree_prio(t->left) > tree_prio(t))) ||
+        (t->right && (t->right->parent != t || tree_prio(t->right) > tree_prio(t)))){
+        return 0;
+    }
+    return tree_check(t->left, lo, t) && tree_check(t->right, t, hi);
+}
+#endif
+
+/**********************************************************
+ * arena_check
+ * Check the consistency of the heap of one arena
  * Return nonzero if the heap is consistant.
  *********************************************************/
-int mm_check(void){
-    void* it = prologue;
-    for (it = prologue; it < epilogue; it = NEXT_BLKP(it)){
+int arena_check(arena *a){
+    void* it = a->prologue;
+    for (it = a->prologue; it < a->epilogue; it = NEXT_BLKP(it)){
         // no block is of size 0
         if(GET_SIZE(HDRP(it)) == 0){
             return 0;
         }
-        // headers and footers match
-        if(GET(HDRP(it)) != GET(HDRP(it))){
+        // the next block knows whether this one is allocated
+        if(!GET_PREV_ALLOC(HDRP(NEXT_BLKP(it))) != !GET_ALLOC(HDRP(it))){
             return 0;
         }
         
         if(!GET_ALLOC(HDRP(it))){
+            // headers and footers of free blocks match
+            if(GET_SIZE(HDRP(it)) != GET_SIZE(FTRP(it))){
+                return 0;
+            }
             // is every free block in the free list (and occurs once only)?
-            if(count_in_free_list(it) != 1){
+            if(count_in_free_list(a, it) != 1){
                 return 0;
             }
             // are there any free blocks that escaped coalescing?
@@ -677,27 +2545,84 @@ int mm_check(void){
         }
 
         // is there any overlapping?
-        if(FTRP(it) > HDRP(NEXT_BLKP(it))){
+        if((char*)it + GET_SIZE(HDRP(it)) > (char*)a->epilogue){
             return 0;
         }
     }
     // last block is always epilogue
-    if (it != epilogue){
+    if (it != a->epilogue){
         return 0;
     }
 
     // is every block in the free list marked as free?
+    // and does the occupancy map agree with the lists?
     int i;
     for (i = 0; i < NUM_LISTS; i++) {
-        list_block *ls = seg_lists[i];
+        list_block *ls = a->seg_lists[i];
+        int mapped = (a->seg_map[i / MAP_BITS] >> (i % MAP_BITS)) & 1;
+#if LARGE_TREE
+        if (i == TREE_CLASS){
+            if (ls || mapped != (a->tree != NULL) || (a->tree && a->tree->parent) ||
+                !tree_check(a->tree, NULL, NULL)){
+                return 0;
+            }
+            continue;
+        }
+#endif
+        if (mapped != (ls != NULL)){
+            return 0;
+        }
         if (!ls) continue;
         do {
             if(GET_ALLOC(HDRP(ls))){
                 return 0;
             }
             ls = ls->next;
-        } while (ls != seg_lists[i]); 
+        } while (ls != a->seg_lists[i]); 
+    }
+#ifdef DEFER_COALESCE
+    // blocks on a quick list are still marked allocated and of the
+    // size of their list
+    for (i = 0; i < QUICK_BINS; i++) {
+        list_block *blk;
+        for (blk = a->quick[i]; blk; blk = blk->next) {
+            if (!GET_ALLOC(HDRP(blk)) || QUICK_INDEX(GET_SIZE(HDRP(blk))) != i){
+                return 0;
+            }
+        }
+    }
+#endif
+#if SLAB_MAX_SIZE > 0
+    // every run on a slab list is an allocated run page with a free slot
+    for (i = 0; i < SLAB_CLASSES; i++) {
+        slab_run *run;
+        for (run = a->slab_runs[i]; run; run = run->next) {
+            if (slab_of(a, run) != run || run->nfree == 0 || !GET_ALLOC(HDRP(run))){
+                return 0;
+            }
+        }
     }
+#endif
+    return 1;
+}
+
+/**********************************************************
+ * mm_check
+ * Check the consistency of the memory heap of every arena
+ * Return nonzero if the heap is consistant.
+ *********************************************************/
+int mm_check(void){
+    if (!arena_check(&main_arena)){
+        return 0;
+    }
+#if NUM_ARENAS > 1
+    int i;
+    for (i = 1; i < NUM_ARENAS; i++) {
+        if (arenas[i] && !arena_check(arenas[i])){
+            return 0;
+        }
+    }
+#endif
     return 1;
 }
 
@@ -6,7 +6,37 @@
 int mm_init(void);
 void *mm_malloc(size_t size);
 void mm_free(void *ptr);
+/* size is what ptr was allocated with, only a hint unless THREAD_SAFE */
+void mm_free_sized(void *ptr, size_t size);
 void *mm_realloc(void *ptr, size_t size);
+void *mm_memalign(size_t align, size_t size);
+int mm_malloc_batch(size_t size, int n, void **out);
+/* sorts ptrs in place by address before freeing */
+void mm_free_batch(void **ptrs, int n);
+int mm_trim(size_t pad);
+size_t mm_usable_size(void *ptr);
+
+/* What became of the realloc calls that reached the heap since mm_init,
+ * and how often the arena locks were taken (thread-safe builds only) */
+typedef struct {
+    unsigned long realloc_calls;
+    unsigned long realloc_in_place; /* resized without moving the payload */
+    unsigned long realloc_moved;    /* slid into the free block before it */
+    unsigned long realloc_copied;   /* copied to a new block */
+    unsigned long bytes_moved;      /* payload bytes moved or copied */
+    unsigned long lock_acquired;    /* arena lock taken */
+    unsigned long lock_contended;   /* ... after waiting for another thread */
+} mm_stats_t;
+
+void mm_get_stats(mm_stats_t *stats);
+
+/* nonzero if the allocator was built with THREAD_SAFE */
+extern const int mm_thread_safe;
+
+/* pthread_atfork handlers, thread-safe builds only */
+void mm_fork_prepare(void);
+void mm_fork_parent(void);
+void mm_fork_child(void);
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, personal
@@ -0,0 +1,175 @@
+/*
+ * mm_preload.c
+ * Exposes the allocator as a drop-in malloc for real programs:
+ *
+ *   make libmm.so
+ *   LD_PRELOAD=./libmm.so python3 -c 'print(42)'
+ *
+ * libmm.so is mm.c built thread-safe over memlib_vm.c, which reserves
+ * the heap in real virtual memory, with this file on top exporting
+ * the malloc family. Everything else in the library is hidden so that
+ * none of mm.c's helpers can clash with the program's own symbols.
+ * The heap is set up by the first call, whichever thread makes it.
+ *
+ * fork takes every arena lock first and releases them in the parent
+ * and the child, so that a child forked while another thread is
+ * allocating finds the heap consistent and the locks free.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define EXPORT __attribute__((visibility("default")))
+
+static int initialized = 0;
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void shim_init(void)
+{
+    pthread_mutex_lock(&init_lock);
+    if (!initialized) {
+        mem_init();
+        if (mm_init() < 0)
+            abort();
+        pthread_atfork(mm_fork_prepare, mm_fork_parent, mm_fork_child);
+        __atomic_store_n(&initialized, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&init_lock);
+}
+
+#define ENSURE_INIT() \
+    do { if (!__atomic_load_n(&initialized, __ATOMIC_ACQUIRE)) shim_init(); } while (0)
+
+static void *aligned_malloc(size_t align, size_t size)
+{
+    ENSURE_INIT();
+    void *ptr = mm_memalign(align, size ? size : 1);
+    if (ptr == NULL)
+        errno = ENOMEM;
+    return ptr;
+}
+
+/**********************************************************
+ * The malloc family
+ **********************************************************/
+EXPORT void *malloc(size_t size)
+{
+    ENSURE_INIT();
+    // malloc(0) has to return a pointer free accepts
+    void *ptr = mm_malloc(size ? size : 1);
+    if (ptr == NULL)
+        errno = ENOMEM;
+    return ptr;
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    mm_free(ptr);
+}
+
+/* C23, size is what the block was allocated with */
+EXPORT void free_sized(void *ptr, size_t size)
+{
+    mm_free_sized(ptr, size ? size : 1);
+}
+
+EXPORT void free_aligned_sized(void *ptr, size_t align, size_t size)
+{
+    mm_free_sized(ptr, size ? size : 1);
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes;
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *ptr = malloc(bytes);
+    if (ptr)
+        memset(ptr, 0, bytes);
+    return ptr;
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    void *newptr = mm_realloc(ptr, size);
+    if (newptr == NULL)
+        errno = ENOMEM;
+    return newptr;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, bytes);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    if (align < sizeof(void *) || (align & (align - 1)))
+        return EINVAL;
+    int saved_errno = errno;
+    void *ptr = aligned_malloc(align, size);
+    if (ptr == NULL)
+        return ENOMEM;
+    errno = saved_errno;
+    *memptr = ptr;
+    return 0;
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+    if (align == 0 || (align & (align - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return aligned_malloc(align, size);
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+    // like glibc, round an alignment that is no power of two up
+    size_t pow2 = 1;
+    while (pow2 < align)
+        pow2 *= 2;
+    return aligned_malloc(pow2, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return aligned_malloc(getpagesize(), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+    size_t page = getpagesize();
+    if (size > SIZE_MAX - page) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return aligned_malloc(page, (size + page - 1) & ~(page - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+    return mm_usable_size(ptr);
+}
@@ -0,0 +1,1102 @@
+/*
+ * replay.c
+ * Trace replay benchmark built from source, as an alternative to the
+ * prebuilt mdriver. Reads the same .rep format (heap size, id count,
+ * op count, weight, then one "a id size", "r id size" or "f id" per
+ * line) and reports for every trace:
+ *
+ *   util     peak live payload over the peak heap size
+ *   Kops/s   best of the timed runs, ops only
+ *   p50/p99/p999
+ *            per-op latency in ns, read with clock_gettime around
+ *            every op, so it includes the cost of reading the clock
+ *   copies/moves
+ *            reallocs that copied the payload to a new block, and
+ *            that slid it down into the free block before it, over
+ *            one replay of the trace, "n/a" for glibc
+ *   with -p, cycles, instructions, cache and branch misses per op
+ *            from perf_event_open, "n/a" where the kernel refuses
+ *
+ * A trace named "-" is read from stdin. Traces of more than STREAM_OPS
+ * ops, those from stdin and all of them with -s are streamed instead:
+ * replayed once, a chunk at a time as they are read, with every
+ * LAT_SAMPLE-th op timed into a latency histogram, so that traces from
+ * tracegen of any length fit in memory.
+ *
+ * Every trace runs in a child process of its own, so it starts from a
+ * fresh heap even with glibc, and is first replayed once untimed to
+ * check the allocator: payloads must be aligned, lie in the heap and
+ * keep their contents until they are freed or reallocated.
+ *
+ * With -T threads the timed runs are spread over that many threads
+ * instead, and the latency columns make way for the serial throughput,
+ * the speedup over it and the arena lock counts. -m picks how:
+ *
+ *   shard     thread i replays the ids with id % threads == i
+ *   copies    every thread replays the whole trace on ids of its own
+ *   prodcons  like shard, but every block is freed by the next thread
+ *
+ * New threads of the thread-safe mm.c take turns on its arenas, and the
+ * first run on each pays for faulting its pages in, which the best of
+ * the default 10 runs leaves out.
+ *
+ * The allocator is mm.c as compiled into the binary, or glibc malloc
+ * with -l. The Makefile builds one binary per allocator variant,
+ * replay-<variant>, and "make replay-all" runs them all. Only
+ * replay-ts and -l are safe with more than one thread, the other
+ * variants refuse -T above 1.
+ *
+ * usage: replay [-l] [-p] [-s] [-n runs] [-t tracedir]
+ *               [-T threads] [-m shard|copies|prodcons] [tracefile...]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define ALIGNMENT 16
+
+/* the traces mdriver runs by default, in its order */
+static const char *default_traces[] = {
+    "amptjp-bal.rep", "cccp-bal.rep", "cp-decl-bal.rep", "expr-bal.rep",
+    "coalescing-bal.rep", "random-bal.rep", "random2-bal.rep",
+    "binary-bal.rep", "binary2-bal.rep", "realloc-bal.rep",
+    "realloc2-bal.rep",
+};
+#define NUM_DEFAULT_TRACES (sizeof(default_traces) / sizeof(default_traces[0]))
+
+typedef struct {
+    char type;      /* 'a', 'r' or 'f' */
+    int id;
+    size_t size;
+} trace_op;
+
+typedef struct {
+    int num_ids;
+    int num_ops;
+    trace_op *ops;
+} trace;
+
+typedef struct {
+    const char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    size_t (*heap_size)(void);
+    /* realloc and arena lock counts since init, NULL if there are none */
+    void (*stats)(mm_stats_t *stats);
+    int in_heap;    /* payloads must lie in the memlib heap */
+} allocator;
+
+/**********************************************************
+ * Harness memory
+ * Comes straight from mmap, so that with -l the trace and
+ * the bookkeeping do not share the glibc heap being measured
+ **********************************************************/
+void *xcalloc(size_t n, size_t size)
+{
+    size_t len = n * size + sizeof(size_t);
+    size_t *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    *p = len;
+    return p + 1;
+}
+
+void xfree(void *ptr)
+{
+    size_t *p = (size_t*)ptr - 1;
+    munmap(p, *p);
+}
+
+/**********************************************************
+ * The two allocators
+ **********************************************************/
+int mm_reset(void)
+{
+    mem_reset_brk();
+    return mm_init();
+}
+
+int libc_init(void)
+{
+    return 0;
+}
+
+size_t libc_heap_size(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+#else
+    struct mallinfo mi = mallinfo();
+#endif
+    return mi.arena + mi.hblkhd;
+}
+
+allocator mm_allocator = {
+    "mm", mm_reset, mm_malloc, mm_free, mm_realloc, mem_heapsize,
+    mm_get_stats, 1
+};
+allocator libc_allocator = {
+    "libc", libc_init, malloc, free, realloc, libc_heap_size, NULL, 0
+};
+
+enum { MODE_SHARD, MODE_COPIES, MODE_PRODCONS };
+const char *mode_names[] = { "shard", "copies", "prodcons" };
+
+int num_threads = 0;    /* 0 replays serially */
+int mode = MODE_SHARD;
+int stream = 0;         /* stream every trace */
+
+/**********************************************************
+ * Reading traces
+ * The ops are parsed by hand from a buffer of their own,
+ * scanf takes longer than most allocators on an op
+ **********************************************************/
+#define STREAM_OPS (1 << 22)    /* longer traces are streamed */
+
+typedef struct {
+    FILE *f;
+    const char *path;
+    int num_ids;
+    long num_ops;   /* as the header says */
+    long line;      /* ops read so far */
+    int pos, len;
+    char buf[1 << 16];
+} trace_reader;
+
+/* open path and read its header, NULL if it cannot be opened */
+trace_reader *open_trace(const char *path)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    trace_reader *r;
+    int heap_size, weight;
+
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    r = xcalloc(1, sizeof(trace_reader));
+    r->f = f;
+    r->path = path;
+    if (fscanf(f, "%d %d %ld %d", &heap_size, &r->num_ids,
+               &r->num_ops, &weight) != 4 || r->num_ids < 0 || r->num_ops < 0) {
+        fprintf(stderr, "%s: bad header\n", path);
+        exit(1);
+    }
+    return r;
+}
+
+void close_trace(trace_reader *r)
+{
+    if (r->f != stdin)
+        fclose(r->f);
+    xfree(r);
+}
+
+static inline int next_char(trace_reader *r)
+{
+    if (r->pos == r->len) {
+        r->len = fread(r->buf, 1, sizeof(r->buf), r->f);
+        r->pos = 0;
+        if (r->len <= 0)
+            return EOF;
+    }
+    return r->buf[r->pos++];
+}
+
+/* the next number, c is its first digit */
+static inline unsigned long read_num(trace_reader *r, int *c)
+{
+    unsigned long v = 0;
+    while (*c == ' ' || *c == '\t')
+        *c = next_char(r);
+    if (*c < '0' || *c > '9')
+        *c = -2;    // not a number
+    while (*c >= '0' && *c <= '9') {
+        v = v * 10 + *c - '0';
+        *c = next_char(r);
+    }
+    return v;
+}
+
+/* read up to n ops into ops, return how many, 0 at the end */
+int read_ops(trace_reader *r, trace_op *ops, int n)
+{
+    int i, c;
+    for (i = 0; i < n; i++) {
+        trace_op *op = &ops[i];
+        do {
+            c = next_char(r);
+        } while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+        if (c == EOF)
+            break;
+        op->type = c;
+        c = next_char(r);
+        op->id = read_num(r, &c);
+        if (op->type == 'a' || op->type == 'r')
+            op->size = read_num(r, &c);
+        else if (op->type != 'f')
+            c = -2;
+        if (c == -2 || op->id < 0 || op->id >= r->num_ids) {
+            fprintf(stderr, "%s: bad op %ld\n", r->path, r->line + i);
+            exit(1);
+        }
+    }
+    r->line += i;
+    return i;
+}
+
+/* load the rest of the trace behind r */
+trace *read_trace(trace_reader *r)
+{
+    trace *t = xcalloc(1, sizeof(trace));
+    t->num_ids = r->num_ids;
+    t->ops = xcalloc(r->num_ops, sizeof(trace_op));
+    t->num_ops = read_ops(r, t->ops, r->num_ops);
+    return t;
+}
+
+void free_trace(trace *t)
+{
+    xfree(t->ops);
+    xfree(t);
+}
+
+/**********************************************************
+ * Checking pass
+ * Fills every payload with a byte derived from its id and
+ * checks it is still there when the block is freed or
+ * reallocated, which catches overlapping blocks. Returns
+ * the utilization, or -1 if the allocator got it wrong
+ **********************************************************/
+int check_payload(unsigned char *p, size_t size, int id)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        if (p[i] != (unsigned char)id)
+            return 0;
+    }
+    return 1;
+}
+
+double check_trace(allocator *alloc, trace *t, const char *name)
+{
+    void **ptrs = xcalloc(t->num_ids, sizeof(void*));
+    size_t *sizes = xcalloc(t->num_ids, sizeof(size_t));
+    size_t live = 0, peak_live = 0, peak_heap = 0, heap;
+    int i;
+
+    // hand back what earlier traces left in the glibc heap, so the
+    // peak below belongs to this trace
+    if (!alloc->in_heap)
+        malloc_trim(0);
+    if (alloc->init() < 0) {
+        fprintf(stderr, "%s: init failed\n", name);
+        return -1;
+    }
+    for (i = 0; i < t->num_ops; i++) {
+        trace_op *op = &t->ops[i];
+        void *p;
+
+        if (op->type == 'f') {
+            if (!check_payload(ptrs[op->id], sizes[op->id], op->id)) {
+                fprintf(stderr, "%s: op %d: block %d was overwritten\n",
+                        name, i, op->id);
+                return -1;
+            }
+            alloc->free(ptrs[op->id]);
+            live -= sizes[op->id];
+            ptrs[op->id] = NULL;
+            sizes[op->id] = 0;
+        } else {
+            if (op->type == 'a') {
+                p = alloc->malloc(op->size);
+            } else {
+                size_t kept = sizes[op->id] < op->size ? sizes[op->id] : op->size;
+                p = alloc->realloc(ptrs[op->id], op->size);
+                if (p != NULL && !check_payload(p, kept, op->id)) {
+                    fprintf(stderr, "%s: op %d: realloc lost the contents "
+                            "of block %d\n", name, i, op->id);
+                    return -1;
+                }
+            }
+            if (p == NULL && op->size > 0) {
+                fprintf(stderr, "%s: op %d: out of memory\n", name, i);
+                return -1;
+            }
+            if ((uintptr_t)p % ALIGNMENT) {
+                fprintf(stderr, "%s: op %d: %p is not aligned\n", name, i, p);
+                return -1;
+            }
+            if (alloc->in_heap && op->size > 0 &&
+                ((char*)p < (char*)mem_heap_lo() ||
+                 (char*)p + op->size - 1 > (char*)mem_heap_hi())) {
+                fprintf(stderr, "%s: op %d: %p is outside the heap\n", name, i, p);
+                return -1;
+            }
+            memset(p, (unsigned char)op->id, op->size);
+            live += op->size - sizes[op->id];
+            ptrs[op->id] = p;
+            sizes[op->id] = op->size;
+        }
+        if (live > peak_live)
+            peak_live = live;
+        heap = alloc->heap_size();
+        if (heap > peak_heap)
+            peak_heap = heap;
+    }
+    for (i = 0; i < t->num_ids; i++) {
+        alloc->free(ptrs[i]);
+    }
+    xfree(ptrs);
+    xfree(sizes);
+    return peak_heap ? (double)peak_live / peak_heap : 0;
+}
+
+/**********************************************************
+ * Hardware counters
+ * One group led by the cycle counter, read around a timed
+ * run. Counters the kernel refuses stay at -1
+ **********************************************************/
+#define NUM_COUNTERS 4
+
+static const char *counter_names[NUM_COUNTERS] = {
+    "cycles", "instr", "cache-miss", "br-miss"
+};
+static const unsigned long long counter_configs[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+int counter_fds[NUM_COUNTERS] = {-1, -1, -1, -1};
+
+void counters_open(void)
+{
+    int i;
+    for (i = 0; i < NUM_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counter_configs[i];
+        attr.disabled = 1;
+        attr.inherit = 1;   // count the replay threads too
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counter_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+void counters_start(void)
+{
+    int i;
+    for (i = 0; i < NUM_COUNTERS; i++) {
+        if (counter_fds[i] >= 0) {
+            ioctl(counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void counters_stop(long long *values)
+{
+    int i;
+    for (i = 0; i < NUM_COUNTERS; i++) {
+        values[i] = -1;
+        if (counter_fds[i] >= 0) {
+            ioctl(counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter_fds[i], &values[i], sizeof(values[i])) != sizeof(values[i]))
+                values[i] = -1;
+        }
+    }
+}
+
+/**********************************************************
+ * Timed passes
+ **********************************************************/
+static inline double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static inline void do_op(allocator *alloc, trace_op *op, void **ptrs)
+{
+    switch (op->type) {
+    case 'a':
+        ptrs[op->id] = alloc->malloc(op->size);
+        break;
+    case 'r':
+        ptrs[op->id] = alloc->realloc(ptrs[op->id], op->size);
+        break;
+    default:
+        alloc->free(ptrs[op->id]);
+        ptrs[op->id] = NULL;
+    }
+}
+
+void free_all(allocator *alloc, trace *t, void **ptrs)
+{
+    int i;
+    for (i = 0; i < t->num_ids; i++) {
+        alloc->free(ptrs[i]);
+        ptrs[i] = NULL;
+    }
+}
+
+/* replay t once, return the seconds the ops took */
+double time_trace(allocator *alloc, trace *t, void **ptrs, long long *counters)
+{
+    double start, end;
+    int i;
+
+    alloc->init();
+    if (counters)
+        counters_start();
+    start = now();
+    for (i = 0; i < t->num_ops; i++) {
+        do_op(alloc, &t->ops[i], ptrs);
+    }
+    end = now();
+    if (counters)
+        counters_stop(counters);
+    free_all(alloc, t, ptrs);
+    return end - start;
+}
+
+/* replay t once, appending the latency of every op to lat */
+void latency_trace(allocator *alloc, trace *t, void **ptrs, long *lat)
+{
+    int i;
+
+    alloc->init();
+    for (i = 0; i < t->num_ops; i++) {
+        long start = now_ns();
+        do_op(alloc, &t->ops[i], ptrs);
+        lat[i] = now_ns() - start;
+    }
+    free_all(alloc, t, ptrs);
+}
+
+/**********************************************************
+ * Threaded replay
+ * Every thread replays its own list of ops. In prodcons
+ * mode a thread does not free a block itself but pushes it
+ * on a ring read by the next thread, which frees it
+ **********************************************************/
+#define RING_SIZE 1024  /* power of two */
+
+typedef struct {
+    void *slots[RING_SIZE];
+    // producer and consumer side on cache lines of their own
+    unsigned long tail __attribute__((aligned(64)));
+    int closed;         /* the producer is done */
+    unsigned long head __attribute__((aligned(64)));
+} ring;
+
+typedef struct {
+    allocator *alloc;
+    trace_op *ops;
+    int num_ops;
+    void **ptrs;
+    ring *inbox;        /* blocks to free for the previous thread */
+    ring *outbox;       /* blocks for the next thread to free */
+    int failed;
+    double start, end;  /* when this thread began and finished */
+} worker_arg;
+
+pthread_barrier_t start_barrier;
+
+/* free everything waiting in w's inbox, return how many */
+int ring_drain(worker_arg *w)
+{
+    ring *r = w->inbox;
+    unsigned long head = r->head;
+    unsigned long tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    int n = tail - head;
+    for (; head != tail; head++) {
+        w->alloc->free(r->slots[head & (RING_SIZE - 1)]);
+    }
+    __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+void ring_push(worker_arg *w, void *ptr)
+{
+    ring *r = w->outbox;
+    // a full ring waits for its consumer, which may be waiting on
+    // us in turn, so keep our own inbox moving meanwhile
+    while (r->tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RING_SIZE) {
+        if (ring_drain(w) == 0)
+            sched_yield();
+    }
+    r->slots[r->tail & (RING_SIZE - 1)] = ptr;
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+void *replay_worker(void *p)
+{
+    worker_arg *w = (worker_arg*)p;
+    int i;
+
+    pthread_barrier_wait(&start_barrier);
+    w->start = now();
+    for (i = 0; i < w->num_ops; i++) {
+        trace_op *op = &w->ops[i];
+        if (op->type == 'f' && w->outbox) {
+            ring_push(w, w->ptrs[op->id]);
+            w->ptrs[op->id] = NULL;
+        } else {
+            do_op(w->alloc, op, w->ptrs);
+            if (op->type != 'f' && op->size > 0) {
+                if (w->ptrs[op->id] == NULL) {
+                    w->failed = 1;
+                    break;
+                }
+                // touch the payload so the block is really used
+                *(char*)w->ptrs[op->id] = (char)i;
+            }
+        }
+        if (w->inbox)
+            ring_drain(w);
+    }
+    if (w->outbox)
+        __atomic_store_n(&w->outbox->closed, 1, __ATOMIC_RELEASE);
+    if (w->inbox) {
+        // closed is read first, everything pushed before it was set
+        // is then seen by the drain
+        int closed, n;
+        do {
+            closed = __atomic_load_n(&w->inbox->closed, __ATOMIC_ACQUIRE);
+            if ((n = ring_drain(w)) == 0 && !closed)
+                sched_yield();
+        } while (n || !closed);
+    }
+    w->end = now();
+    return NULL;
+}
+
+/* replay t on num_threads threads once, return the seconds it took */
+double time_threaded(allocator *alloc, trace *t, worker_arg *args,
+                     ring *rings, long long *counters)
+{
+    pthread_t threads[num_threads];
+    double start = 0, end = 0;
+    int i;
+
+    alloc->init();
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+    for (i = 0; i < num_threads; i++) {
+        if (mode == MODE_PRODCONS) {
+            memset(&rings[i], 0, sizeof(ring));
+            args[i].inbox = &rings[i];
+            args[i].outbox = &rings[(i + 1) % num_threads];
+        }
+        pthread_create(&threads[i], NULL, replay_worker, &args[i]);
+    }
+    if (counters)
+        counters_start();
+    pthread_barrier_wait(&start_barrier);
+    // from the first thread to start to the last to finish, the
+    // threads may well get going before this one is scheduled again
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        if (i == 0 || args[i].start < start)
+            start = args[i].start;
+        if (i == 0 || args[i].end > end)
+            end = args[i].end;
+    }
+    if (counters)
+        counters_stop(counters);
+    pthread_barrier_destroy(&start_barrier);
+
+    for (i = 0; i < num_threads; i++) {
+        if (args[i].failed) {
+            fprintf(stderr, "out of memory with %d threads\n", num_threads);
+            exit(1);
+        }
+        // the shards share one ptrs array
+        if (i == 0 || mode == MODE_COPIES)
+            free_all(alloc, t, args[i].ptrs);
+    }
+    return end - start;
+}
+
+/* split the ops of t over num_threads workers as mode says */
+worker_arg *split_trace(allocator *alloc, trace *t)
+{
+    worker_arg *args = xcalloc(num_threads, sizeof(worker_arg));
+    void **shared = xcalloc(t->num_ids, sizeof(void*));
+    int i, j;
+
+    for (i = 0; i < num_threads; i++) {
+        worker_arg *w = &args[i];
+        w->alloc = alloc;
+        if (mode == MODE_COPIES) {
+            w->ops = t->ops;
+            w->num_ops = t->num_ops;
+            w->ptrs = xcalloc(t->num_ids, sizeof(void*));
+            continue;
+        }
+        w->ptrs = shared;
+        w->ops = xcalloc(t->num_ops, sizeof(trace_op));
+        for (j = 0; j < t->num_ops; j++) {
+            if (t->ops[j].id % num_threads == i)
+                w->ops[w->num_ops++] = t->ops[j];
+        }
+    }
+    return args;
+}
+
+void free_split(trace *t, worker_arg *args)
+{
+    int i;
+    for (i = 0; i < num_threads; i++) {
+        if (mode == MODE_COPIES)
+            xfree(args[i].ptrs);
+        else
+            xfree(args[i].ops);
+    }
+    if (mode != MODE_COPIES)
+        xfree(args[0].ptrs);
+    xfree(args);
+}
+
+int cmp_long(const void *a, const void *b)
+{
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+/* the q quantile of n sorted values */
+long quantile(long *sorted, long n, double q)
+{
+    long i = (long)(q * n);
+    return sorted[i < n ? i : n - 1];
+}
+
+typedef struct {
+    int valid;
+    long num_ops;   /* over all threads */
+    double util;
+    double secs;    /* best time of the ops */
+} trace_result;
+
+/* the realloc counts of the one replay since the last init */
+void print_realloc_stats(allocator *alloc)
+{
+    mm_stats_t stats;
+    if (alloc->stats == NULL) {
+        printf(" %7s %7s", "n/a", "n/a");
+        return;
+    }
+    alloc->stats(&stats);
+    printf(" %7lu %7lu", stats.realloc_copied, stats.realloc_moved);
+}
+
+void print_counters(long long *counters, long num_ops)
+{
+    int k;
+    for (k = 0; k < NUM_COUNTERS; k++) {
+        if (counters[k] < 0)
+            printf(" %10s", "n/a");
+        else
+            printf(" %10.1f", (double)counters[k] / num_ops);
+    }
+}
+
+/* time t on num_threads threads and print it next to the serial time */
+void run_threaded(allocator *alloc, trace *t, const char *name, int runs,
+                  int use_counters, trace_result *res)
+{
+    worker_arg *args = split_trace(alloc, t);
+    ring *rings = mode == MODE_PRODCONS ? xcalloc(num_threads, sizeof(ring)) : NULL;
+    long long counters[NUM_COUNTERS], best_counters[NUM_COUNTERS];
+    mm_stats_t stats = {0};
+    double serial = res->secs;
+    int r;
+
+    for (r = 0; r < runs; r++) {
+        double secs = time_threaded(alloc, t, args, rings,
+                                    use_counters ? counters : NULL);
+        if (r == 0 || secs < res->secs) {
+            res->secs = secs;
+            memcpy(best_counters, counters, sizeof(counters));
+            if (alloc->stats)
+                alloc->stats(&stats);
+        }
+    }
+    if (mode == MODE_COPIES)
+        res->num_ops = t->num_ops * num_threads;
+
+    double rate = res->num_ops / res->secs;
+    printf("%-20s %7ld %9.0f %9.0f %7.2fx", name, res->num_ops,
+           t->num_ops / serial / 1e3, rate / 1e3, rate * serial / t->num_ops);
+    if (alloc->stats)
+        printf(" %7.2f %9.2f%%", (double)stats.lock_acquired / res->num_ops,
+               stats.lock_acquired ?
+               100.0 * stats.lock_contended / stats.lock_acquired : 0);
+    else
+        printf(" %7s %10s", "n/a", "n/a");
+    if (use_counters)
+        print_counters(best_counters, res->num_ops);
+    printf("\n");
+    res->valid = 1;
+
+    if (rings)
+        xfree(rings);
+    free_split(t, args);
+}
+
+/**********************************************************
+ * Streaming
+ * The trace is replayed once, STREAM_CHUNK ops at a time.
+ * Only the ops are timed, one in LAT_SAMPLE of them on its
+ * own as well. The latencies go to a histogram with 8
+ * buckets per power of two, exact below 64ns
+ **********************************************************/
+#define STREAM_CHUNK 65536
+#define LAT_SAMPLE 16   /* power of two */
+#define HIST_BUCKETS (64 + 8 * 58)
+
+static inline int hist_bucket(long ns)
+{
+    if (ns < 64)
+        return ns < 0 ? 0 : ns;
+    int e = 63 - __builtin_clzl(ns);
+    return 64 + (e - 6) * 8 + ((ns >> (e - 3)) & 7);
+}
+
+/* the lowest latency in bucket b */
+long hist_value(int b)
+{
+    if (b < 64)
+        return b;
+    int e = (b - 64) / 8 + 6;
+    return (long)(8 + (b - 64) % 8) << (e - 3);
+}
+
+long hist_quantile(long *hist, double q)
+{
+    long n = 0, seen = 0;
+    int b;
+    for (b = 0; b < HIST_BUCKETS; b++)
+        n += hist[b];
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > q * n)
+            return hist_value(b);
+    }
+    return 0;
+}
+
+void stream_trace(allocator *alloc, trace_reader *r, const char *name,
+                  int use_counters, trace_result *res)
+{
+    trace_op *chunk = xcalloc(STREAM_CHUNK, sizeof(trace_op));
+    void **ptrs = xcalloc(r->num_ids, sizeof(void*));
+    size_t *sizes = xcalloc(r->num_ids, sizeof(size_t));
+    long *hist = xcalloc(HIST_BUCKETS, sizeof(long));
+    long long counters[NUM_COUNTERS], totals[NUM_COUNTERS] = {0};
+    size_t live = 0, peak_live = 0, peak_heap = 0, heap;
+    int i, k, n;
+
+    if (alloc->init() < 0) {
+        fprintf(stderr, "%s: init failed\n", name);
+        return;
+    }
+    while ((n = read_ops(r, chunk, STREAM_CHUNK)) > 0) {
+        if (use_counters)
+            counters_start();
+        double start = now();
+        for (i = 0; i < n; i++) {
+            trace_op *op = &chunk[i];
+            if ((i & (LAT_SAMPLE - 1)) == 0) {
+                long op_start = now_ns();
+                do_op(alloc, op, ptrs);
+                hist[hist_bucket(now_ns() - op_start)]++;
+            } else {
+                do_op(alloc, op, ptrs);
+            }
+            if (op->type != 'f' && ptrs[op->id] == NULL && op->size > 0)
+                break;
+        }
+        res->secs += now() - start;
+        if (use_counters) {
+            counters_stop(counters);
+            for (k = 0; k < NUM_COUNTERS; k++)
+                totals[k] = counters[k] < 0 || totals[k] < 0 ? -1 : totals[k] + counters[k];
+        }
+        if (i < n) {
+            fprintf(stderr, "%s: op %ld: out of memory\n", name,
+                    res->num_ops + i);
+            printf("%-20s %7ld invalid\n", name, res->num_ops + i);
+            return;
+        }
+
+        // the live payload only depends on the trace
+        for (i = 0; i < n; i++) {
+            trace_op *op = &chunk[i];
+            if (op->type == 'f') {
+                live -= sizes[op->id];
+                sizes[op->id] = 0;
+            } else {
+                live += op->size - sizes[op->id];
+                sizes[op->id] = op->size;
+            }
+            if (live > peak_live)
+                peak_live = live;
+        }
+        // the heap only between chunks, mallinfo is slow
+        heap = alloc->heap_size();
+        if (heap > peak_heap)
+            peak_heap = heap;
+        res->num_ops += n;
+    }
+    if (res->num_ops != r->num_ops)
+        fprintf(stderr, "%s: %ld ops, the header says %ld\n", name,
+                res->num_ops, r->num_ops);
+    if (res->num_ops == 0) {
+        printf("%-20s %7d empty\n", name, 0);
+        return;
+    }
+    for (i = 0; i < r->num_ids; i++) {
+        alloc->free(ptrs[i]);
+    }
+
+    res->util = peak_heap ? (double)peak_live / peak_heap : 0;
+    printf("%-20s %7ld %4.0f%% %9.0f %6ld %6ld %7ld", name, res->num_ops,
+           100 * res->util, res->num_ops / res->secs / 1e3,
+           hist_quantile(hist, 0.5), hist_quantile(hist, 0.99),
+           hist_quantile(hist, 0.999));
+    print_realloc_stats(alloc);
+    if (use_counters)
+        print_counters(totals, res->num_ops);
+    printf("\n");
+    res->valid = 1;
+
+    xfree(hist);
+    xfree(sizes);
+    xfree(ptrs);
+    xfree(chunk);
+}
+
+/* check, time and print one trace, the results go to res */
+void run_trace(allocator *alloc, const char *path, const char *name,
+               int runs, int use_counters, trace_result *res)
+{
+    trace_reader *reader;
+    trace *t;
+    int r;
+
+    if ((reader = open_trace(path)) == NULL)
+        exit(1);
+    if (stream || reader->f == stdin || reader->num_ops > STREAM_OPS) {
+        if (num_threads) {
+            fprintf(stderr, "%s: streamed traces are replayed on one thread\n", name);
+            exit(1);
+        }
+        stream_trace(alloc, reader, name, use_counters, res);
+        close_trace(reader);
+        return;
+    }
+    t = read_trace(reader);
+    close_trace(reader);
+    res->num_ops = t->num_ops;
+    res->util = check_trace(alloc, t, name);
+    if (res->util < 0) {
+        printf("%-20s %7d invalid\n", name, t->num_ops);
+        free_trace(t);
+        return;
+    }
+
+    void **ptrs = xcalloc(t->num_ids, sizeof(void*));
+    long long counters[NUM_COUNTERS], best_counters[NUM_COUNTERS];
+    for (r = 0; r < runs; r++) {
+        double secs = time_trace(alloc, t, ptrs, use_counters ? counters : NULL);
+        if (r == 0 || secs < res->secs) {
+            res->secs = secs;
+            memcpy(best_counters, counters, sizeof(counters));
+        }
+    }
+
+    if (num_threads) {
+        run_threaded(alloc, t, name, runs, use_counters, res);
+        xfree(ptrs);
+        free_trace(t);
+        return;
+    }
+
+    long n = (long)t->num_ops * runs;
+    long *lat = xcalloc(n, sizeof(long));
+    for (r = 0; r < runs; r++) {
+        latency_trace(alloc, t, ptrs, lat + (long)r * t->num_ops);
+    }
+    qsort(lat, n, sizeof(long), cmp_long);
+
+    printf("%-20s %7d %4.0f%% %9.0f %6ld %6ld %7ld", name, t->num_ops,
+           100 * res->util, t->num_ops / res->secs / 1e3, quantile(lat, n, 0.5),
+           quantile(lat, n, 0.99), quantile(lat, n, 0.999));
+    print_realloc_stats(alloc);
+    if (use_counters)
+        print_counters(best_counters, t->num_ops);
+    printf("\n");
+    res->valid = 1;
+
+    xfree(lat);
+    xfree(ptrs);
+    free_trace(t);
+}
+
+int main(int argc, char *argv[])
+{
+    allocator *alloc = &mm_allocator;
+    const char *tracedir = "../traces";
+    int runs = 10, use_counters = 0;
+    int c, i, num_traces, num_valid = 0;
+    const char **trace_files;
+    double total_util = 0, total_secs = 0;
+    long total_ops = 0;
+
+    while ((c = getopt(argc, argv, "lpsn:t:T:m:")) != -1) {
+        switch (c) {
+        case 'l': alloc = &libc_allocator; break;
+        case 'p': use_counters = 1; break;
+        case 's': stream = 1; break;
+        case 'n': runs = atoi(optarg); break;
+        case 't': tracedir = optarg; break;
+        case 'T': num_threads = atoi(optarg); break;
+        case 'm':
+            for (mode = 0; mode <= MODE_PRODCONS; mode++) {
+                if (strcmp(optarg, mode_names[mode]) == 0)
+                    break;
+            }
+            if (mode <= MODE_PRODCONS)
+                break;
+            // fall through
+        default:
+            fprintf(stderr, "usage: %s [-l] [-p] [-s] [-n runs] [-t tracedir] "
+                    "[-T threads] [-m shard|copies|prodcons] "
+                    "[tracefile...]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (runs < 1 || num_threads < 0) {
+        fprintf(stderr, "runs must be positive, threads not negative\n");
+        exit(1);
+    }
+    if (num_threads > 1 && alloc == &mm_allocator && !mm_thread_safe) {
+        fprintf(stderr, "mm.c was built without THREAD_SAFE, use replay-ts or -l "
+                "for more than one thread\n");
+        exit(1);
+    }
+    if (optind < argc) {
+        // trace files named on the command line are used as given
+        num_traces = argc - optind;
+        trace_files = (const char**)&argv[optind];
+        tracedir = NULL;
+    } else {
+        num_traces = NUM_DEFAULT_TRACES;
+        trace_files = default_traces;
+    }
+
+    if (num_threads)
+        printf("%-20s %7s %9s %9s %8s %7s %10s", "trace", "ops",
+               "serial", "Kops/s", "speedup", "locks", "contended");
+    else
+        printf("%-20s %7s %5s %9s %6s %6s %7s %7s %7s", "trace", "ops", "util",
+               "Kops/s", "p50", "p99", "p999", "copies", "moves");
+    if (use_counters) {
+        for (i = 0; i < NUM_COUNTERS; i++)
+            printf(" %10s", counter_names[i]);
+    }
+    printf("\n");
+
+    for (i = 0; i < num_traces; i++) {
+        char path[1024];
+        const char *name = trace_files[i];
+        trace_result res = {0};
+        int fds[2], status;
+        pid_t pid;
+
+        if (tracedir)
+            snprintf(path, sizeof(path), "%s/%s", tracedir, name);
+        else
+            snprintf(path, sizeof(path), "%s", name);
+
+        fflush(stdout);
+        if (pipe(fds) < 0 || (pid = fork()) < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            // the memlib heap is itself a 20MB malloc, keep it out of
+            // the glibc numbers
+            if (alloc->in_heap)
+                mem_init();
+            if (use_counters)
+                counters_open();
+            run_trace(alloc, path, name, runs, use_counters, &res);
+            fflush(stdout);
+            if (write(fds[1], &res, sizeof(res)) != sizeof(res))
+                _exit(1);
+            _exit(0);
+        }
+        close(fds[1]);
+        if (read(fds[0], &res, sizeof(res)) != sizeof(res))
+            res.valid = 0;
+        close(fds[0]);
+        waitpid(pid, &status, 0);
+        if (WIFSIGNALED(status))
+            printf("%-20s %7s crashed\n", name, "");
+
+        if (res.valid) {
+            num_valid++;
+            total_util += res.util;
+            total_secs += res.secs;
+            total_ops += res.num_ops;
+        }
+    }
+
+    if (num_valid && num_threads)
+        printf("%-20s %7ld %9s %9.0f\n", "total", total_ops, "",
+               total_ops / total_secs / 1e3);
+    else if (num_valid)
+        printf("%-20s %7ld %4.0f%% %9.0f\n", "total", total_ops,
+               100 * total_util / num_valid, total_ops / total_secs / 1e3);
+    if (num_threads)
+        printf("allocator: %s, %d threads, %s, best of %d runs, "
+               "locks per op%s\n", alloc->name, num_threads,
+               mode_names[mode], runs, use_counters ? ", counters per op" : "");
+    else
+        printf("allocator: %s, best of %d runs, latencies in ns per op%s\n",
+               alloc->name, runs, use_counters ? ", counters per op" : "");
+    return num_valid == num_traces ? 0 : 1;
+}
@@ -0,0 +1,325 @@
+/*
+ * tracegen.c
+ * Generates allocation traces in the .rep format of ../traces from a
+ * parameterized model, at any length. The trace is written as it is
+ * generated, so it can be piped straight into the replay harness:
+ *
+ *   tracegen -n 1000000000 | replay -
+ *
+ * The model:
+ *   sizes      power law between -m and -M bytes with exponent -a,
+ *              most requests are small and a few are very large
+ *   lifetimes  how many ops a block lives, exponential or pareto
+ *              (heavy tailed, most blocks die young) with mean -l
+ *   realloc    with probability -r a new block becomes a growth
+ *              chain: it is reallocated up to -c times, growing by
+ *              a factor of -g every time, before it dies
+ *   phases     with -p the trace is cut into that many phases, each
+ *              with its own scale of sizes and lifetimes
+ *
+ * At most -i blocks and -b payload bytes are live at any time, the
+ * block due to die first is freed early to stay under either. The
+ * trace is balanced: every block is freed by the last op. Blocks are
+ * named by ids from 0 to -i - 1, which are reused once freed. Written
+ * to a file with -o, the header is patched at the end to the number of
+ * ids actually used, mdriver insists on that.
+ *
+ * mdriver also wrongly reports that realloc lost the data of blocks
+ * whose id modulo 256 is 128 or more, whatever the allocator, so check
+ * generated traces with replay instead.
+ *
+ * usage: tracegen [-n ops] [-i max_live] [-b max_bytes] [-a alpha]
+ *                 [-m min_size] [-M max_size] [-L exp|pareto] [-l life]
+ *                 [-r chain_prob] [-g growth] [-c chain_len]
+ *                 [-p phases] [-s seed] [-o file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+long num_ops = 1000000;
+int max_live = 10000;
+long max_bytes = 8 << 20;   /* mm.c has to fit in the 20MB memlib heap */
+double alpha = 1.5;
+double min_size = 16;
+double max_size = 65536;
+int pareto_life = 0;
+double mean_life = 1000;
+double chain_prob = 0.01;
+double growth = 1.5;
+int chain_len = 20;
+int num_phases = 1;
+unsigned long long seed = 1;
+
+/**********************************************************
+ * Random numbers
+ * xorshift64*, so that a seed gives the same trace on
+ * every machine
+ **********************************************************/
+unsigned long long rand_state;
+
+double uniform(void)
+{
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    // the top 53 bits, never exactly 0
+    return ((rand_state * 2685821657736338717ULL >> 11) + 0.5) / 9007199254740992.0;
+}
+
+double exponential(double mean)
+{
+    return -mean * log(uniform());
+}
+
+/* pareto with shape 1.2, scaled to the given mean */
+double pareto(double mean)
+{
+    const double shape = 1.2;
+    double scale = mean * (shape - 1) / shape;
+    return scale * pow(uniform(), -1 / shape);
+}
+
+/**********************************************************
+ * Phases
+ * Every phase scales the sizes by 1 to 8 and the lifetimes
+ * by 1/4 to 4, drawn when the phase starts
+ **********************************************************/
+double size_scale = 1, life_scale = 1;
+
+void new_phase(void)
+{
+    size_scale = pow(2, 3 * uniform());
+    life_scale = pow(2, 4 * uniform() - 2);
+}
+
+size_t sample_size(void)
+{
+    // inverse transform of a power law truncated to [min, max]
+    double lo = pow(min_size, 1 - alpha), hi = pow(max_size, 1 - alpha);
+    double x = pow(lo + (hi - lo) * uniform(), 1 / (1 - alpha));
+    x *= size_scale;
+    return x > max_size ? (size_t)max_size : (size_t)x;
+}
+
+long sample_life(void)
+{
+    double mean = mean_life * life_scale;
+    return 1 + (long)(pareto_life ? pareto(mean) : exponential(mean));
+}
+
+/**********************************************************
+ * Output
+ * Formatted by hand into a large buffer, printf would be
+ * the bottleneck for traces of billions of ops
+ **********************************************************/
+#define OUT_SIZE (1 << 20)
+char out_buf[OUT_SIZE];
+int out_len = 0;
+FILE *out;
+
+void put_num(unsigned long v)
+{
+    char tmp[24];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n)
+        out_buf[out_len++] = tmp[--n];
+}
+
+void put_op(char type, int id, size_t size)
+{
+    if (out_len > OUT_SIZE - 64) {
+        fwrite(out_buf, 1, out_len, out);
+        out_len = 0;
+    }
+    out_buf[out_len++] = type;
+    out_buf[out_len++] = ' ';
+    put_num(id);
+    if (type != 'f') {
+        out_buf[out_len++] = ' ';
+        put_num(size);
+    }
+    out_buf[out_len++] = '\n';
+}
+
+/**********************************************************
+ * Events
+ * Every live block has exactly one pending event, its next
+ * realloc or its death, in a min-heap ordered by the op at
+ * which it is due
+ **********************************************************/
+typedef struct {
+    long due;
+    int id;
+} event;
+
+event *events;
+int num_events = 0;
+
+void event_push(long due, int id)
+{
+    int i = num_events++;
+    while (i > 0 && events[(i - 1) / 2].due > due) {
+        events[i] = events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    events[i].due = due;
+    events[i].id = id;
+}
+
+event event_pop(void)
+{
+    event top = events[0], last = events[--num_events];
+    int i = 0, child;
+    while ((child = 2 * i + 1) < num_events) {
+        if (child + 1 < num_events && events[child + 1].due < events[child].due)
+            child++;
+        if (events[child].due >= last.due)
+            break;
+        events[i] = events[child];
+        i = child;
+    }
+    events[i] = last;
+    return top;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *out_path = NULL;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:i:b:a:m:M:L:l:r:g:c:p:s:o:")) != -1) {
+        switch (c) {
+        case 'n': num_ops = atol(optarg); break;
+        case 'i': max_live = atoi(optarg); break;
+        case 'b': max_bytes = atol(optarg); break;
+        case 'a': alpha = atof(optarg); break;
+        case 'm': min_size = atof(optarg); break;
+        case 'M': max_size = atof(optarg); break;
+        case 'L': pareto_life = strcmp(optarg, "pareto") == 0; break;
+        case 'l': mean_life = atof(optarg); break;
+        case 'r': chain_prob = atof(optarg); break;
+        case 'g': growth = atof(optarg); break;
+        case 'c': chain_len = atoi(optarg); break;
+        case 'p': num_phases = atoi(optarg); break;
+        case 's': seed = strtoull(optarg, NULL, 0); break;
+        case 'o': out_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-n ops] [-i max_live] [-b max_bytes] "
+                    "[-a alpha] [-m min_size] [-M max_size] [-L exp|pareto] "
+                    "[-l life] [-r chain_prob] [-g growth] [-c chain_len] "
+                    "[-p phases] [-s seed] [-o file]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (num_ops < 2 || max_live < 1 || max_bytes < max_size || alpha == 1 ||
+        min_size < 1 || max_size < min_size || num_phases < 1 || growth < 1) {
+        fprintf(stderr, "bad parameters: need ops >= 2, max_bytes >= max_size, "
+                "alpha != 1, 1 <= min_size <= max_size, growth >= 1\n");
+        exit(1);
+    }
+    out = stdout;
+    if (out_path && (out = fopen(out_path, "w")) == NULL) {
+        perror(out_path);
+        exit(1);
+    }
+
+    // per block: payload size and reallocs left in its chain
+    size_t *sizes = calloc(max_live, sizeof(size_t));
+    int *chain = calloc(max_live, sizeof(int));
+    int *free_ids = malloc(max_live * sizeof(int));
+    int num_free = max_live, phase = 0, max_id = 0, i;
+    long live_bytes = 0, op;
+    events = malloc(max_live * sizeof(event));
+    for (i = 0; i < max_live; i++) {
+        free_ids[i] = max_live - 1 - i;
+    }
+
+    rand_state = seed ? seed : 1;
+    new_phase();
+    // suggested heap size, ids, ops, weight. The ids are padded so
+    // that the real count fits in later
+    fprintf(out, "%ld\n%-10d\n%ld\n1\n", max_bytes, max_live, num_ops);
+
+    for (op = 0; op < num_ops; op++) {
+        long left = num_ops - op;
+        int live = max_live - num_free;
+
+        if (op * num_phases / num_ops != phase) {
+            phase = op * num_phases / num_ops;
+            new_phase();
+        }
+
+        if (live > 0 && left == live + 1) {
+            // one op more than the frees still needed, and a new block
+            // would need two: resize a block in place of it
+            put_op('r', events[0].id, sizes[events[0].id]);
+            continue;
+        }
+
+        if (live > 0 && (left <= live || events[0].due <= op || num_free == 0)) {
+            event e = event_pop();
+            if (chain[e.id] > 0 && left > live) {
+                size_t size = sizes[e.id] * growth + 1;
+                if (size > max_size)
+                    size = max_size;
+                if (live_bytes + (long)(size - sizes[e.id]) <= max_bytes) {
+                    live_bytes += size - sizes[e.id];
+                    sizes[e.id] = size;
+                    put_op('r', e.id, size);
+                    if (--chain[e.id] == 0 || size == max_size) {
+                        chain[e.id] = 0;
+                        event_push(op + sample_life(), e.id);
+                    } else {
+                        event_push(op + 1 + (long)exponential(mean_life * life_scale / chain_len), e.id);
+                    }
+                    continue;
+                }
+            }
+            put_op('f', e.id, 0);
+            live_bytes -= sizes[e.id];
+            chain[e.id] = 0;
+            free_ids[num_free++] = e.id;
+            continue;
+        }
+
+        // make room by freeing whatever is due first, every free
+        // takes an op but also needs one less at the end
+        size_t size = sample_size();
+        while (live_bytes + (long)size > max_bytes) {
+            event e = event_pop();
+            put_op('f', e.id, 0);
+            live_bytes -= sizes[e.id];
+            chain[e.id] = 0;
+            free_ids[num_free++] = e.id;
+            op++;
+        }
+
+        int id = free_ids[--num_free];
+        if (id > max_id)
+            max_id = id;
+        sizes[id] = size;
+        live_bytes += size;
+        if (uniform() < chain_prob) {
+            chain[id] = chain_len;
+            event_push(op + 1 + (long)exponential(mean_life * life_scale / chain_len), id);
+        } else {
+            event_push(op + sample_life(), id);
+        }
+        put_op('a', id, size);
+    }
+
+    fwrite(out_buf, 1, out_len, out);
+    // free ids are taken lowest first, so 0 to max_id were all used
+    if (out != stdout && fseek(out, 0, SEEK_SET) == 0)
+        fprintf(out, "%ld\n%-10d", max_bytes, max_id + 1);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * bench_hash.cc
+ * Times counting samples in the chained table of hash.h against the
+ * open addressing table of flat_hash.h and the dense counter of
+ * dense_count.h. The samples are drawn the way
+ * randtrack draws them, but up front, so that only the counting is
+ * timed and not rand_r. Each table counts them three times and the
+ * best run is reported.
+ *
+ *   make bench_hash             single threaded
+ *   make bench_hash_lock_free   tables lock-free, any thread count
+ *
+ * The dense counter is privatized, -DDENSE_ATOMIC times its shared
+ * mode instead.
+ *
+ * usage: bench_hash [num_threads] [samples_per_stream] [samples_to_skip]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "flat_hash.h"
+#include "dense_count.h"
+
+#define RAND_NUM_UPPER_BOUND   100000
+#define NUM_SEED_STREAMS            4
+
+class sample;
+
+class sample {
+  unsigned my_key;
+ public:
+  sample *next;
+  unsigned count;
+
+  sample(unsigned the_key){my_key = the_key; count = 0;};
+  unsigned key(){return my_key;}
+  void print(FILE *f){fprintf(f,"%d %d\n",my_key,count);}
+};
+
+hash<sample,unsigned> chained;
+flat_hash<unsigned> flat;
+dense_count<unsigned> dense;
+
+unsigned *keys;
+long num_keys;
+int num_threads = 1;
+
+double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+class tdata{
+public:
+  int idx;
+  int table;
+  long begin;
+  long end;
+};
+
+void *count_keys(void *ptr){
+  tdata *data = (tdata *) ptr;
+  long i;
+
+  for (i = data->begin; i < data->end; i++){
+    if (data->table == 0){
+#ifdef LOCK_FREE
+      chained.lookup_and_insert_if_absent(keys[i]);
+#else
+      sample *s = chained.lookup(keys[i], NULL);
+      if (!s){
+        s = new sample(keys[i]);
+        chained.insert(s);
+      }
+      s->count++;
+#endif
+    } else if (data->table == 1){
+      flat.lookup_and_insert_if_absent(keys[i]);
+    } else {
+      dense.count(data->idx, keys[i]);
+    }
+  }
+  return NULL;
+}
+
+// ns per sample to count every key into the given table
+double run(int table){
+  pthread_t *threads = new pthread_t[num_threads];
+  tdata *data = new tdata[num_threads];
+  double start = now();
+  int t;
+
+  for (t = 0; t < num_threads; t++){
+    data[t].idx = t;
+    data[t].table = table;
+    data[t].begin = num_keys * t / num_threads;
+    data[t].end = num_keys * (t + 1) / num_threads;
+    pthread_create(&threads[t], NULL, count_keys, &data[t]);
+  }
+  for (t = 0; t < num_threads; t++){
+    pthread_join(threads[t], NULL);
+  }
+  if (table == 2)
+    dense.merge();
+  double ns = (now() - start) * 1e9 / num_keys;
+  delete [] threads;
+  delete [] data;
+  return ns;
+}
+
+int
+main(int argc, char *argv[]){
+  long samples = 1000000;
+  unsigned skip = 1;
+  long i, j;
+  unsigned k;
+
+  if (argc > 1) num_threads = atoi(argv[1]);
+  if (argc > 2) samples = atol(argv[2]);
+  if (argc > 3) skip = atoi(argv[3]);
+#ifndef LOCK_FREE
+  if (num_threads != 1){
+    fprintf(stderr, "only the lock-free build counts with more than one thread\n");
+    exit(1);
+  }
+#endif
+  if (num_threads < 1 || samples < 1){
+    fprintf(stderr, "usage: %s [num_threads] [samples_per_stream] [samples_to_skip]\n", argv[0]);
+    exit(1);
+  }
+
+  num_keys = samples * NUM_SEED_STREAMS;
+  keys = new unsigned[num_keys];
+  for (i = 0; i < NUM_SEED_STREAMS; i++){
+    int rnum = i;
+    for (j = 0; j < samples; j++){
+      for (k = 0; k < skip; k++){
+        rnum = rand_r((unsigned int*)&rnum);
+      }
+      keys[i * samples + j] = rnum % RAND_NUM_UPPER_BOUND;
+    }
+  }
+
+  chained.setup(14);
+#ifdef LOCK_FREE
+  flat.setup(18);
+#else
+  // starts small to go through the doubling too
+  flat.setup(14);
+#endif
+  dense.setup(RAND_NUM_UPPER_BOUND, num_threads);
+  // best of three runs, emptying the tables in between
+  double chained_ns = 0, flat_ns = 0, dense_ns = 0;
+  for (i = 0; i < 3; i++){
+    double ns;
+    chained.reset();
+    ns = run(0);
+    if (i == 0 || ns < chained_ns) chained_ns = ns;
+    flat.reset();
+    ns = run(1);
+    if (i == 0 || ns < flat_ns) flat_ns = ns;
+    dense.cleanup();
+    dense.setup(RAND_NUM_UPPER_BOUND, num_threads);
+    ns = run(2);
+    if (i == 0 || ns < dense_ns) dense_ns = ns;
+  }
+
+  // both tables have to agree on every count
+  unsigned long long distinct = 0;
+  for (i = 0; i < (1 << chained.size()); i++){
+    for (sample *s = chained.get_list(i)->head(); s; s = s->next){
+      unsigned *count = flat.lookup(s->key());
+      unsigned *dense_count = dense.lookup(s->key());
+      if (!count || *count != s->count || !dense_count || *dense_count != s->count){
+        fprintf(stderr, "count of %u differs: %u vs %u vs %u\n", s->key(), s->count,
+                count ? *count : 0, dense_count ? *dense_count : 0);
+        exit(1);
+      }
+      distinct++;
+    }
+  }
+  if (distinct != flat.num_ele()){
+    fprintf(stderr, "distinct keys differ: %llu vs %llu\n", distinct, flat.num_ele());
+    exit(1);
+  }
+
+  printf("%d threads, %ld samples, %llu distinct keys\n", num_threads, num_keys, distinct);
+  printf("chained  %7.2f ns/sample\n", chained_ns);
+  printf("flat     %7.2f ns/sample  (%.2fx)\n", flat_ns, chained_ns / flat_ns);
+  printf("dense    %7.2f ns/sample  (%.2fx, %s)\n", dense_ns, chained_ns / dense_ns,
+         dense.privatized() ? "privatized" : "shared");
+  chained.cleanup();
+  flat.cleanup();
+  dense.cleanup();
+  delete [] keys;
+  return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef DENSE_COUNT_H
+#define DENSE_COUNT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// allow configuring debug via commandline -DDBG
+#ifndef DBG
+#define DBG_PRINT(...)       (void)NULL;
+#define DBG_ASSERT(expr)     (void)NULL;
+#else
+#define DBG_PRINT(...)       printf(__VA_ARGS__);
+#define DBG_ASSERT(expr)     assert(expr);
+#endif
+
+// Counts keys from a small dense range 0..num_keys-1 in an array
+// indexed by the key itself, no hashing and no probing at all.
+//
+// Privatized, every thread counts into its own row and merge() sums
+// the rows into the shared counts once the threads are done. Shared,
+// every thread counts straight into the shared counts with atomic
+// adds. setup() privatizes unless the rows would take more than
+// DENSE_PRIVATE_MAX bytes, -DDENSE_ATOMIC always shares.
+#ifndef DENSE_PRIVATE_MAX
+#define DENSE_PRIVATE_MAX (64 << 20)
+#endif
+
+// rows are padded to whole cache lines, so that no two threads
+// ever write to the same line
+#define DENSE_LINE 64
+#define DENSE_ROW_ALIGN (DENSE_LINE / sizeof(unsigned))
+
+// 8 counts added at once by merge(), gcc picks the widest vector
+// instructions the target has and splits the rest
+typedef unsigned dense_vec __attribute__((vector_size(32)));
+
+template<class Keytype> class dense_count {
+ private:
+  unsigned my_num_keys;
+  unsigned my_row_len;
+  unsigned my_num_threads;
+  bool my_privatized;
+  unsigned *shared;
+  unsigned *rows;
+
+  unsigned *alloc_counts(size_t n);
+
+ public:
+  void setup(unsigned num_keys, unsigned num_threads);
+  bool privatized() { return my_privatized; };
+  void count(unsigned thread, Keytype key);
+  void merge();
+  unsigned *lookup(Keytype the_key);
+  void print(FILE *f=stdout);
+  void cleanup();
+};
+
+// n zeroed counts, aligned to a cache line
+template<class Keytype>
+unsigned *
+dense_count<Keytype>::alloc_counts(size_t n){
+  void *p;
+  if (posix_memalign(&p, DENSE_LINE, n * sizeof(unsigned)) != 0){
+    fprintf(stderr,"dense_count<Keytype>: out of memory!\n");
+    exit(1);
+  }
+  memset(p, 0, n * sizeof(unsigned));
+  return (unsigned *)p;
+}
+
+template<class Keytype>
+void
+dense_count<Keytype>::setup(unsigned num_keys, unsigned num_threads){
+  my_num_keys = num_keys;
+  my_row_len = (num_keys + DENSE_ROW_ALIGN - 1) / DENSE_ROW_ALIGN * DENSE_ROW_ALIGN;
+  my_num_threads = num_threads;
+#ifdef DENSE_ATOMIC
+  my_privatized = false;
+#else
+  my_privatized = (size_t)my_row_len * num_threads * sizeof(unsigned) <= DENSE_PRIVATE_MAX;
+#endif
+  DBG_PRINT("dense_count of %u keys, %s\n", num_keys, my_privatized ? "privatized" : "shared");
+  shared = alloc_counts(my_row_len);
+  rows = my_privatized ? alloc_counts((size_t)my_row_len * num_threads) : NULL;
+}
+
+template<class Keytype>
+void
+dense_count<Keytype>::count(unsigned thread, Keytype key){
+  DBG_ASSERT(key < my_num_keys && thread < my_num_threads);
+  if (my_privatized)
+    rows[(size_t)thread * my_row_len + key]++;
+  else
+    __atomic_fetch_add(&shared[key], 1, __ATOMIC_RELAXED);
+}
+
+// sums the rows of every thread into the shared counts, to be called
+// once all threads are done counting
+template<class Keytype>
+void
+dense_count<Keytype>::merge(){
+  unsigned num_vecs = my_row_len / (sizeof(dense_vec) / sizeof(unsigned));
+  dense_vec *sum = (dense_vec *)shared;
+  unsigned t, i;
+
+  if (!my_privatized)
+    return;
+  // the rows are whole, aligned cache lines, so whole vectors too
+  for (t = 0; t < my_num_threads; t++){
+    dense_vec *row = (dense_vec *)(rows + (size_t)t * my_row_len);
+    for (i = 0; i < num_vecs; i++){
+      sum[i] += row[i];
+    }
+    memset(row, 0, my_row_len * sizeof(unsigned));
+  }
+}
+
+// count of the_key, NULL if it has not been counted
+template<class Keytype>
+unsigned *
+dense_count<Keytype>::lookup(Keytype the_key){
+  if (the_key >= my_num_keys || shared[the_key] == 0)
+    return NULL;
+  return &shared[the_key];
+}
+
+// same lines as hash<Ele,Keytype>::print(), already sorted by key
+template<class Keytype>
+void
+dense_count<Keytype>::print(FILE *f){
+  unsigned i;
+
+  for (i=0;i<my_num_keys;i++){
+    if (shared[i])
+      fprintf(f, "%d %d\n", i, shared[i]);
+  }
+}
+
+template<class Keytype>
+void
+dense_count<Keytype>::cleanup(){
+  free(shared);
+  free(rows);
+  shared = rows = NULL;
+}
+
+#endif
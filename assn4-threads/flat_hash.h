@@ -0,0 +1,179 @@
+#ifndef FLAT_HASH_H
+#define FLAT_HASH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+// allow configuring debug via commandline -DDBG
+#ifndef DBG
+#define DBG_PRINT(...)       (void)NULL;
+#define DBG_ASSERT(expr)     (void)NULL;
+#else
+#define DBG_PRINT(...)       printf(__VA_ARGS__);
+#define DBG_ASSERT(expr)     assert(expr);
+#endif
+
+// A counting hash table with open addressing: every key and its count
+// sit inline in one array of slots, and a key is looked for by linear
+// probing from its home slot. Unlike hash.h nothing is allocated per
+// key and a probe touches consecutive slots instead of chasing list
+// pointers. The key ~0 marks an empty slot and cannot be counted.
+//
+// With -DLOCK_FREE any number of threads can count at once, an empty
+// slot is claimed with a CAS on its key and counts are bumped with
+// atomic adds. The table then never grows, it has to be set up with
+// room for every key. Single threaded it doubles at half full.
+
+// fibonacci hashing, the top size_log bits of key * 2^64 / phi
+#define FLAT_HASH_INDEX(_key,_size_log) \
+  ((unsigned)(((unsigned long long)(_key) * 0x9E3779B97F4A7C15ULL) >> (64 - (_size_log))))
+
+template<class Keytype> class flat_hash {
+ private:
+  struct slot {
+    Keytype key;
+    unsigned count;
+  };
+
+  unsigned my_size_log;
+  unsigned my_size;
+  unsigned my_size_mask;
+  unsigned long long my_num_ele;
+  slot *slots;
+
+  static Keytype empty_key() { return (Keytype)~0ULL; }
+  void grow();
+
+ public:
+  void setup(unsigned the_size_log=5);
+  void lookup_and_insert_if_absent(Keytype thekey);
+  unsigned *lookup(Keytype the_key);
+  unsigned size() { return my_size_log; };
+  unsigned long long num_ele() { return my_num_ele; };
+  void print(FILE *f=stdout);
+  void reset();
+  void cleanup();
+};
+
+template<class Keytype>
+void
+flat_hash<Keytype>::setup(unsigned the_size_log){
+  my_size_log = the_size_log;
+  my_size = 1 << my_size_log;
+  my_size_mask = my_size - 1;
+  my_num_ele = 0;
+  slots = new slot[my_size];
+  reset();
+}
+
+// count of the_key, NULL if it has not been counted
+template<class Keytype>
+unsigned *
+flat_hash<Keytype>::lookup(Keytype the_key){
+  unsigned i = FLAT_HASH_INDEX(the_key, my_size_log);
+
+  while (slots[i].key != empty_key()){
+    if (slots[i].key == the_key)
+      return &slots[i].count;
+    i = (i + 1) & my_size_mask;
+  }
+  return NULL;
+}
+
+#ifndef LOCK_FREE
+template<class Keytype>
+void
+flat_hash<Keytype>::lookup_and_insert_if_absent(Keytype thekey){
+  unsigned i = FLAT_HASH_INDEX(thekey, my_size_log);
+
+  DBG_ASSERT(thekey != empty_key());
+  while (slots[i].key != empty_key()){
+    if (slots[i].key == thekey){
+      slots[i].count++;
+      return;
+    }
+    i = (i + 1) & my_size_mask;
+  }
+  slots[i].key = thekey;
+  slots[i].count = 1;
+  if (++my_num_ele * 2 >= my_size)
+    grow();
+}
+
+template<class Keytype>
+void
+flat_hash<Keytype>::grow(){
+  slot *old = slots;
+  unsigned old_size = my_size;
+  unsigned i, j;
+
+  DBG_PRINT("growing flat_hash to 2^%u slots\n", my_size_log + 1);
+  setup(my_size_log + 1);
+  for (i = 0; i < old_size; i++){
+    if (old[i].key == empty_key())
+      continue;
+    j = FLAT_HASH_INDEX(old[i].key, my_size_log);
+    while (slots[j].key != empty_key())
+      j = (j + 1) & my_size_mask;
+    slots[j] = old[i];
+    my_num_ele++;
+  }
+  delete [] old;
+}
+#else
+template<class Keytype>
+void
+flat_hash<Keytype>::lookup_and_insert_if_absent(Keytype thekey){
+  unsigned i = FLAT_HASH_INDEX(thekey, my_size_log);
+  unsigned probes;
+
+  DBG_ASSERT(thekey != empty_key());
+  for (probes = 0; probes < my_size; probes++){
+    Keytype k = __atomic_load_n(&slots[i].key, __ATOMIC_RELAXED);
+    // on failure k is reloaded with the key that won the slot
+    if (k == empty_key() &&
+        __atomic_compare_exchange_n(&slots[i].key, &k, thekey, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+      __atomic_fetch_add(&my_num_ele, 1, __ATOMIC_RELAXED);
+      k = thekey;
+    }
+    if (k == thekey){
+      __atomic_fetch_add(&slots[i].count, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    i = (i + 1) & my_size_mask;
+  }
+  fprintf(stderr,"flat_hash<Keytype>: table of 2^%u slots is full!\n", my_size_log);
+  exit(1);
+}
+#endif
+
+template<class Keytype>
+void
+flat_hash<Keytype>::print(FILE *f){
+  unsigned i;
+
+  for (i=0;i<my_size;i++){
+    if (slots[i].key != empty_key())
+      fprintf(f, "%d %d\n", slots[i].key, slots[i].count);
+  }
+}
+
+template<class Keytype>
+void
+flat_hash<Keytype>::reset(){
+  unsigned i;
+  for (i=0;i<my_size;i++){
+    slots[i].key = empty_key();
+    slots[i].count = 0;
+  }
+  my_num_ele = 0;
+}
+
+template<class Keytype>
+void
+flat_hash<Keytype>::cleanup(){
+  delete [] slots;
+  slots = NULL;
+}
+
+#endif
@@ -122,6 +122,44 @@ list<Ele,Keytype>::lookup_and_insert_if_absent(Keytype the_key) {
     }         
 }
 #endif
+
+#ifdef LOCK_FREE
+// Lock-free: elements are only ever pushed at the head, so a chain
+// seen once stays valid. A thread that misses the key publishes its
+// new element with a CAS on the head, and if another thread got
+// there first it only has to look through the elements pushed since
+template<class Ele, class Keytype>
+void
+list<Ele,Keytype>::lookup_and_insert_if_absent(Keytype the_key) {
+      Ele *head = __atomic_load_n(&my_head, __ATOMIC_ACQUIRE);
+      Ele *stop = NULL;
+      Ele *ele = NULL;
+
+      while (true) {
+          // search the elements pushed since the last look
+          for (Ele *e_tmp = head; e_tmp != stop; e_tmp = e_tmp->next) {
+              if (e_tmp->key() == the_key) {
+                  __atomic_fetch_add(&e_tmp->count, 1, __ATOMIC_RELAXED);
+                  delete ele;
+                  return;
+              }
+          }
+          if (ele == NULL) {
+              ele = new Ele(the_key);
+              ele->count = 1;
+          }
+          ele->next = head;
+          stop = head;
+          // on failure head is reloaded with the current head
+          if (__atomic_compare_exchange_n(&my_head, &head, ele, false,
+                                          __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+              __atomic_fetch_add(&my_num_ele, 1, __ATOMIC_RELAXED);
+              return;
+          }
+      }
+}
+#endif
+
 template<class Ele, class Keytype> 
 Ele *
 list<Ele,Keytype>::pop(){
@@ -0,0 +1,137 @@
+#ifndef RAND_STREAM_H
+#define RAND_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+// allow configuring debug via commandline -DDBG
+#ifndef DBG
+#define DBG_PRINT(...)       (void)NULL;
+#define DBG_ASSERT(expr)     (void)NULL;
+#else
+#define DBG_PRINT(...)       printf(__VA_ARGS__);
+#define DBG_ASSERT(expr)     assert(expr);
+#endif
+
+// The random numbers of a randtrack stream, with random access.
+//
+// randtrack steps a stream with rnum = rand_r(&rnum), which feeds the
+// number rand_r returned back in as the next seed. That throws away
+// rand_r's own LCG state, so the stream is not an LCG and cannot be
+// jumped ahead with LCG arithmetic. It is however a fixed function
+// applied over and over to a 31 bit number, so every stream runs into
+// a cycle: after a tail of my_tail numbers it repeats every my_cycle
+// numbers. For the seeds randtrack uses both are a few thousand. setup()
+// finds them with Brent's cycle detection and records the tail and one
+// lap of the cycle, after which the number at any step is one lookup.
+//
+// A stream whose tail and cycle do not fit in RAND_PATH_MAX numbers
+// is not recorded, and is stepped with rand_r as before.
+#ifndef RAND_PATH_MAX
+#define RAND_PATH_MAX (1 << 24)
+#endif
+
+class rand_stream {
+ private:
+  int my_seed;
+  long long my_tail;
+  long long my_cycle;
+  int *path;
+
+  static int step(int rnum){ return rand_r((unsigned int*)&rnum); }
+
+ public:
+  void setup(int seed);
+  bool recorded(){ return path != NULL; };
+  int seed(){ return my_seed; };
+  // where step n of the stream is in the path, for a recorded stream
+  long long wrap(long long n){
+    return n < my_tail + my_cycle ? n : my_tail + (n - my_tail) % my_cycle;
+  };
+  int path_at(long long pos){ return path[pos]; };
+  void cleanup();
+};
+
+inline void
+rand_stream::setup(int seed){
+  long long power = 1, lam = 1, mu = 0, i;
+  int tortoise = seed, hare = step(seed);
+
+  my_seed = seed;
+  path = NULL;
+  // Brent: the cycle length is the first lap the hare makes back
+  // to where the tortoise last teleported to
+  while (tortoise != hare){
+    if (power == lam){
+      if (power > RAND_PATH_MAX)
+        return;
+      tortoise = hare;
+      power *= 2;
+      lam = 0;
+    }
+    hare = step(hare);
+    lam++;
+  }
+  // the tail ends where a hare one cycle ahead meets the tortoise
+  tortoise = hare = seed;
+  for (i = 0; i < lam; i++){
+    hare = step(hare);
+  }
+  while (tortoise != hare){
+    if (mu + lam > RAND_PATH_MAX)
+      return;
+    tortoise = step(tortoise);
+    hare = step(hare);
+    mu++;
+  }
+
+  DBG_PRINT("stream %d: tail %lld, cycle %lld\n", seed, mu, lam);
+  my_tail = mu;
+  my_cycle = lam;
+  path = new int[mu + lam];
+  path[0] = seed;
+  for (i = 1; i < mu + lam; i++){
+    path[i] = step(path[i - 1]);
+  }
+}
+
+inline void
+rand_stream::cleanup(){
+  delete [] path;
+  path = NULL;
+}
+
+// Walks one stream, every thread has its own
+class rand_cursor {
+ private:
+  rand_stream *my_stream;
+  long long pos;
+  int rnum;
+
+ public:
+  // starts at step n of the stream
+  rand_cursor(rand_stream *s, long long n){
+    my_stream = s;
+    if (s->recorded()){
+      pos = s->wrap(n);
+      rnum = s->path_at(pos);
+    } else {
+      rnum = s->seed();
+      skip(n);
+    }
+  };
+
+  // moves k steps on and returns the number there
+  int skip(long long k){
+    if (my_stream->recorded()){
+      pos = my_stream->wrap(pos + k);
+      rnum = my_stream->path_at(pos);
+    } else {
+      for (; k > 0; k--){
+        rnum = rand_r((unsigned int*)&rnum);
+      }
+    }
+    return rnum;
+  };
+};
+
+#endif
@@ -5,11 +5,30 @@
 
 #include "defs.h"
 #include "hash.h"
+#include "rand_stream.h"
+#ifdef LOCK_FREE
+#include "flat_hash.h"
+#include "dense_count.h"
+#endif
 
 
+#ifndef SAMPLES_TO_COLLECT
 #define SAMPLES_TO_COLLECT   10000000
+#endif
 #define RAND_NUM_UPPER_BOUND   100000
+#ifndef NUM_SEED_STREAMS
 #define NUM_SEED_STREAMS            4
+#endif
+
+#ifdef LOCK_FREE
+// key ranges up to this many keys are counted in a dense array
+// indexed by key, unless a hash table is asked for
+#define DENSE_MAX_KEYS        (1 << 20)
+
+#if !defined(FLAT_HASH) && !defined(CHAINED_HASH) && RAND_NUM_UPPER_BOUND <= DENSE_MAX_KEYS
+#define DENSE_COUNT
+#endif
+#endif
 
 // allow configuring debug via commandline -DDBG
 #ifndef DBG
@@ -46,74 +65,108 @@ class sample {
   unsigned my_key;
  public:
   sample *next;
-  unsigned count;
+  unsigned count;   // only ever changed atomically with -DLOCK_FREE, see list.h
 
   sample(unsigned the_key){my_key = the_key; count = 0;};
   unsigned key(){return my_key;}
-  void print(FILE *f){printf("%d %d\n",my_key,count);}
+  void print(FILE *f){fprintf(f,"%d %d\n",my_key,count);}
 };
 
 // This instantiates an empty hash table
 // it is a C++ template, which means we define the types for
 // the element and key value here: element is "class sample" and
 // key value is "unsigned".  
+// With -DLOCK_FREE the samples are counted without locks, by default
+// in a dense array, see dense_count.h, with -DFLAT_HASH in place in
+// an open addressing table, see flat_hash.h, and with -DCHAINED_HASH
+// in this table
+#if defined(DENSE_COUNT)
+dense_count<unsigned> h;
+#elif defined(FLAT_HASH)
+flat_hash<unsigned> h;
+#else
 hash<sample,unsigned> h;
+#endif
 
+// The samples of all streams are numbered one after the other, stream
+// i holding samples i*SAMPLES_TO_COLLECT up to (i+1)*SAMPLES_TO_COLLECT,
+// and every thread gets an equal run of them. A run can start and end
+// in the middle of a stream, so any number of threads gets an equal
+// share. The counts do not depend on who counted what.
 class tdata{
 public:
-  int begin;
-  int end;
+  int idx;
+  long long begin;
+  long long end;
 };
 
+// stream i is seeded with i, see rand_stream.h for how a thread
+// starts in the middle of one without stepping through the samples
+// before its run
+rand_stream streams[NUM_SEED_STREAMS];
+
+#ifndef LOCK_FREE
 extern pthread_mutex_t* list_lock_to_release;
+#endif
 
 void* func(void *ptr){
   tdata* data = (tdata*) ptr;
-  int i,j,k;
+  long long s, end, n;
+  int i,j;
   int rnum;
   unsigned key;
-  sample *s;
 
   // process streams starting with different initial numbers
- DBG_PRINT("This thread is working from %d to %d\n",data->begin, data->end);
- for (i= data->begin ; i < data->end; i++){
-    rnum = i;
+ DBG_PRINT("This thread is working from %lld to %lld\n",data->begin, data->end);
+ for (s = data->begin; s < data->end; s = end){
+    // the part of stream i in this thread's run starts at sample j
+    i = s / SAMPLES_TO_COLLECT;
+    j = s % SAMPLES_TO_COLLECT;
+    end = (long long)(i + 1) * SAMPLES_TO_COLLECT;
+    if (end > data->end)
+      end = data->end;
+    rand_cursor stream(&streams[i], (long long)j * samples_to_skip);
 
     // collect a number of samples
-    for (j=0; j<SAMPLES_TO_COLLECT; j++){
+    for (n = end - s; n > 0; n--){
 
       // skip a number of samples
-      for (k=0; k<samples_to_skip; k++){
-         rnum = rand_r((unsigned int*)&rnum);
-      }
+      rnum = stream.skip(samples_to_skip);
 
       // force the sample to be within the range of 0..RAND_NUM_UPPER_BOUND-1
       key = rnum % RAND_NUM_UPPER_BOUND;
+#if defined(DENSE_COUNT)
+      h.count(data->idx, key);
+#elif defined(LOCK_FREE)
+      // counts the sample without taking any lock, inserting it
+      // first if it has not been seen before
+      h.lookup_and_insert_if_absent(key);
+#else
+      sample *e;
       pthread_mutex_t* list_lock_to_release = NULL;
       // if this sample has not been counted before
-      if (!(s = h.lookup(key, &list_lock_to_release))){
+      if (!(e = h.lookup(key, &list_lock_to_release))){
         // insert a new element for it into the hash table
-        s = new sample(key);
-        h.insert(s);
-        // increment the count for the sample
-        
+        e = new sample(key);
+        h.insert(e);
       }
 
-      s->count++;
+      // increment the count for the sample
+      e->count++;
 
       pthread_mutex_unlock(list_lock_to_release);
-
+#endif
     }
   }
-
+  return NULL;
 }
 
 
 
 int  
 main (int argc, char* argv[]){
-  int t;
-  pthread_t threads[4] = { 0 };
+  unsigned t;
+  pthread_t *threads;
 
   // Print out team information
   printf( "Team Name: %s\n", team.team );
@@ -132,32 +185,48 @@ main (int argc, char* argv[]){
     printf("Usage: %s <num_threads> <samples_to_skip>\n", argv[0]);
     exit(1);  
   }
-  sscanf(argv[1], " %d", &num_threads); // not used in this single-threaded version
+  sscanf(argv[1], " %d", &num_threads);
   sscanf(argv[2], " %d", &samples_to_skip);
+  if ((int)num_threads < 1){
+    printf("Need at least one thread\n");
+    exit(1);
+  }
+
+  threads = new pthread_t[num_threads];
 
   tdata* data = new tdata[num_threads];
+#if defined(DENSE_COUNT)
+  h.setup(RAND_NUM_UPPER_BOUND, num_threads);
+#elif defined(FLAT_HASH)
+  // a 256K-slot (2**18) table holds every possible key at most 40% full
+  h.setup(18);
+#else
   // initialize a 16K-entry (2**14) hash of empty lists
   h.setup(14);
+#endif
+
+  for (t=0; t < NUM_SEED_STREAMS; t++){
+      streams[t].setup(t);
+  }
 
-  /* create threads 1 and 2 */
-/*
-  1 -> 4 / 1 = 4 (0, 0+4)
-  2 -> 4 / 2 = 2 (0, 0+2), (2, 2+2)
-  4 -> 4 / 4 = 1 (0, 0+1), (1, 1+1), (2, 2+1), (3, 3+1)
-
-*/
-  int i = 0;
-  for (t=0; i < num_threads; t += 4/num_threads,i++){
-      DBG_PRINT("start,end::%d, %d\n", t, t+(4/num_threads));
-      data[i].begin=t;
-      data[i].end=t+(4/num_threads);
-      pthread_create (&threads[i], NULL, func, (void *) &data[i]);
+  // split the samples of all streams evenly over the threads
+  long long total = (long long)NUM_SEED_STREAMS * SAMPLES_TO_COLLECT;
+  for (t=0; t < num_threads; t++){
+      data[t].idx=t;
+      data[t].begin=total * t / num_threads;
+      data[t].end=total * (t + 1) / num_threads;
+      DBG_PRINT("start,end::%lld, %lld\n", data[t].begin, data[t].end);
+      pthread_create (&threads[t], NULL, func, (void *) &data[t]);
   }
 
 
   for (t=0; t < num_threads; t++){
      pthread_join(threads[t], NULL);
   }
+#ifdef DENSE_COUNT
+  // sum the counts of every thread
+  h.merge();
+#endif
   
 
   // print a list of the frequency of all samples
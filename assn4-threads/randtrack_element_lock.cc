@@ -115,7 +115,7 @@ void* func(void *ptr){
 int  
 main (int argc, char* argv[]){
   int t;
-  pthread_t threads[4] = { 0 };
+  pthread_t *threads;
 
   // Print out team information
   printf( "Team Name: %s\n", team.team );
@@ -136,6 +136,13 @@ main (int argc, char* argv[]){
   }
   sscanf(argv[1], " %d", &num_threads); // not used in this single-threaded version
   sscanf(argv[2], " %d", &samples_to_skip);
+  // every thread takes the same number of whole streams
+  if ((int)num_threads < 1 || NUM_SEED_STREAMS % num_threads != 0){
+    printf("num_threads has to divide the %d seed streams\n", NUM_SEED_STREAMS);
+    exit(1);
+  }
+
+  threads = new pthread_t[num_threads];
 
   tdata* data = new tdata[num_threads];
   // initialize a 16K-entry (2**14) hash of empty lists
@@ -149,10 +156,10 @@ main (int argc, char* argv[]){
 
 */
   int i = 0;
-  for (t=0; i < num_threads; t += 4/num_threads,i++){
-      DBG_PRINT("start,end::%d, %d\n", t, t+(4/num_threads));
+  for (t=0; i < num_threads; t += NUM_SEED_STREAMS/num_threads,i++){
+      DBG_PRINT("start,end::%d, %d\n", t, t+(NUM_SEED_STREAMS/num_threads));
       data[i].begin=t;
-      data[i].end=t+(4/num_threads);
+      data[i].end=t+(NUM_SEED_STREAMS/num_threads);
       pthread_create (&threads[i], NULL, func, (void *) &data[i]);
   }
 
@@ -0,0 +1,15 @@
+#usage is ./runscaling.sh $num_skips [$max_threads]
+#times ./randtrack at $num_skips for 1, 2, 4, ... up to $max_threads threads (128 by default)
+#and checks that every thread count prints the same sorted output as 1 thread
+#build the variant to time first, e.g. make randtrack_dense
+skips=$1; max=${2:-128}; TIMEFORMAT=%R; mkdir -p temp
+echo "threads  seconds  speedup"
+t=1; while [ $t -le $max ]; do
+    secs=$( { time ./randtrack $t $skips > temp/$t; } 2>&1 )
+    sort -n temp/$t > temp/sorted$t
+    [ $t -eq 1 ] && base=$secs
+    cmp -s temp/sorted1 temp/sorted$t || echo "output of $t threads differs from 1 thread"
+    awk -v t=$t -v s=$secs -v b=$base 'BEGIN { printf "%7d  %7.2f  %7.2f\n", t, s, b / s }'
+    t=$((t * 2))
+done
+rm -rf temp